@@ -9,12 +9,17 @@
 #ifndef BINARY_FILE_READER_H_
 #define BINARY_FILE_READER_H_
 
+#include <cstdint>
 #include <fstream>
 #include <string>
+#include <vector>
 
 /**
  * binary_file_reader: interface for reading binary files, bit by bit or byte
- * by byte. Wraps an ifstream in binary mode.
+ * by byte. Wraps an ifstream in binary mode. The file is read in large
+ * blocks, and the next bits are kept in a 64 bit window, so any number of
+ * them up to 57 can be looked at with peek_bits before consume moves past
+ * them.
  *
  * @author Chase Geigle
  * @date Summer 2012
@@ -29,6 +34,19 @@ class binary_file_reader
      */
     binary_file_reader(const std::string& fileName);
 
+    /**
+     * Constructs a new binary_file_reader that reads length bytes of the
+     * given file, starting at offset, as if they were a whole file (so
+     * they must end with the padding byte a binary_file_writer writes).
+     * This lets several streams share one file.
+     *
+     * @param fileName File to be opened.
+     * @param offset Where the stream starts in the file.
+     * @param length Length of the stream, padding byte included.
+     */
+    binary_file_reader(const std::string& fileName, std::streamoff offset,
+                       std::streamoff length);
+
     /**
      * Destroys a binary_file_reader, ensuring the file is correctly
      * closed. If the file is already closed, does nothing.
@@ -45,14 +63,50 @@ class binary_file_reader
 
     /**
      * Reads the next byte of the file. Should only be called when
-     * has_bytes() is true.
+     * has_bytes() is true. When at least eight bits are left, the byte is
+     * put together from whole bytes of the file rather than bit by bit.
      *
      * @return The next byte of the file, as a char.
      */
     uint8_t next_byte();
 
     /**
-     * Resets the file pointer to the beginning of the file.
+     * Reads the next count bytes of the file at once, as count calls to
+     * next_byte would; whole blocks are copied straight from the file
+     * when the reader is at a byte boundary. At least 8 * count bits must
+     * be left.
+     *
+     * @param out Where to store the bytes.
+     * @param count How many bytes to read.
+     */
+    void read_bytes(uint8_t* out, std::streamoff count);
+
+    /**
+     * Looks at the next n bits without reading them. Bits past the end
+     * of the file are 0.
+     *
+     * @param n How many bits to look at, at most 57.
+     * @return The bits, the first one highest, in the low n bits.
+     */
+    uint64_t peek_bits(unsigned n);
+
+    /**
+     * Moves past bits that have been looked at with peek_bits.
+     *
+     * @param n How many bits to skip, at most 57 and at most bits_left().
+     */
+    void consume(unsigned n);
+
+    /**
+     * Counts the bits that have not been read yet, padding excluded.
+     *
+     * @return The number of bits left in the file.
+     */
+    std::streamoff bits_left() const;
+
+    /**
+     * Resets the file pointer to the beginning of the file (or of the
+     * stream, for a reader of part of a file).
      */
     void reset();
 
@@ -72,36 +126,48 @@ class binary_file_reader
     /**
      * Determines if there are more **bytes** to be read in the file.
      *
-     * @return Whether or not there exists at least one more unread
-     * byte in the file.
+     * @return Whether or not there are at least eight more unread bits
+     * in the file.
      */
     bool has_bytes() const;
 
   private:
     /// Used to read in the file
     std::ifstream file;
-    /// The current byte to read bits from.
-    uint8_t current_byte_;
-    /// The current bit within the current byte that is being read
-    int8_t current_bit_;
-    /// The total number of bytes in the file
-    int max_bytes_;
-    /// The number of bytes read from the file
-    int num_read_;
+    /// Where the stream starts in the file
+    std::streamoff start_;
+    /// The total number of bytes in the stream, padding byte excluded
+    std::streamoff max_bytes_;
     /// The number of padding bits there are in the final byte
     int8_t padding_bits_;
+    /// The number of bits in the stream, padding excluded
+    std::streamoff total_bits_;
+    /// The number of bits read so far
+    std::streamoff bits_read_;
+    /// The bytes of the stream after those already in the window
+    std::vector<uint8_t> block_;
+    /// The next byte of block_ to go into the window
+    size_t block_pos_;
+    /// The number of bytes of the stream read into blocks so far
+    std::streamoff bytes_loaded_;
+    /// The next bits of the stream, the first one highest
+    uint64_t window_;
+    /// How many bits window_ holds
+    unsigned window_bits_;
+
+    /// How many bytes are read from the file at a time
+    const static size_t block_size_ = 1 << 16;
 
     /**
-     * Determines whether or not another byte needs read from the file.
-     *
-     * @return Whether or not another byte must be read.
+     * Reads the next block of the stream into block_. Returns whether
+     * there was anything left to read.
      */
-    bool needs_next_byte() const;
+    bool read_block();
 
     /**
-     * Reads in a single byte from the file.
+     * Tops window_ up to at least 57 bits, or to the end of the stream.
      */
-    void read_next_byte();
+    void fill_window();
 };
 
 #endif
@@ -9,12 +9,16 @@
 #ifndef BINARY_FILE_WRITER_H_
 #define BINARY_FILE_WRITER_H_
 
+#include <cstdint>
 #include <fstream>
 #include <string>
+#include <vector>
 
 /**
  * binary_file_writer: interface for writing to binary files, bit by bit or
- * byte by byte. Wraps an ofstream in binary mode.
+ * byte by byte. Wraps an ofstream in binary mode. Bits are gathered in a
+ * 64 bit word, and whole words in a buffer that goes to the file when it
+ * fills up or the file is closed.
  *
  * @author Chase Geigle
  * @date Sumer 2012
@@ -29,6 +33,16 @@ class binary_file_writer
      */
     binary_file_writer(const std::string& fileName);
 
+    /**
+     * Constructs a new binary_file_writer that adds to the end of the
+     * given file instead of replacing it, so several streams (each ending
+     * in its own padding byte) can share one file.
+     *
+     * @param fileName File to be opened.
+     * @param append Whether to keep the file's current contents.
+     */
+    binary_file_writer(const std::string& fileName, bool append);
+
     /**
      * Destroys an binary_file_writer: the destructor here ensures that
      * all remaining bits are written to the file before closing the
@@ -50,6 +64,15 @@ class binary_file_writer
      */
     void write_byte(uint8_t byte);
 
+    /**
+     * Writes the low count bits of value, high bit first, as count calls
+     * to write_bit would.
+     *
+     * @param value The bits to be written.
+     * @param count How many bits to write, at most 64.
+     */
+    void write_bits(uint64_t value, unsigned count);
+
     /**
      * Closes the given file.
      */
@@ -58,14 +81,25 @@ class binary_file_writer
   private:
     /// Used to write to the file
     std::ofstream file;
-    /// The current byte to write bits into
-    uint8_t current_byte_;
-    /// The current bit within the current byte that is being written
-    int8_t current_bit_;
+    /// The bits written since the last whole word, in its low bits
+    uint64_t word_;
+    /// How many bits word_ holds
+    unsigned word_bits_;
+    /// Whole words waiting to be written to the file
+    std::vector<char> buffer_;
+
+    /// How many bytes buffer_ holds before it is written out
+    const static size_t buffer_size_ = 1 << 16;
+
+    /**
+     * Adds a full word to the buffer, writing the buffer out if it is
+     * full.
+     */
+    void write_word_(uint64_t word);
 
     /**
-     * Writes the current byte to the file.
+     * Writes the buffer to the file and empties it.
      */
-    void write_current_byte_();
+    void flush_buffer_();
 };
 #endif
@@ -0,0 +1,77 @@
+/**
+ * @file byte_histogram.h
+ * Definition of a class for counting the bytes of large inputs.
+ */
+
+#ifndef BYTE_HISTOGRAM_H_
+#define BYTE_HISTOGRAM_H_
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <vector>
+
+#include "frequency.h"
+
+/**
+ * byte_histogram: how many times each byte value occurs in some data.
+ * Counts are 64 bits, so any input can be counted. Data is counted into
+ * four tables at once, a byte to each in turn, so consecutive equal bytes
+ * do not wait on each other's increments; the tables are added up
+ * afterwards. Streams can be counted a chunk per thread.
+ */
+class byte_histogram
+{
+  public:
+    /**
+     * Counts a run of bytes.
+     *
+     * @param data The bytes to count.
+     * @param size How many there are.
+     */
+    void add(const char* data, size_t size);
+
+    /**
+     * Counts the rest of a stream, reading it a chunk at a time. With
+     * more than one thread, a batch of chunks is read at once and each
+     * chunk is counted on its own thread.
+     *
+     * @param input The stream to be read to its end.
+     * @param threads How many chunks to count at once; 0 for one per
+     * core.
+     */
+    void add(std::istream& input, unsigned threads = 1);
+
+    /**
+     * Adds another histogram's counts to this one.
+     *
+     * @param other The histogram to add.
+     */
+    void merge(const byte_histogram& other);
+
+    /**
+     * @return The count of every byte value.
+     */
+    const std::array<uint64_t, 256>& counts() const;
+
+    /**
+     * Makes the frequency objects of the bytes that occur, in order of
+     * byte value (as unsigned char). frequency counts are ints, and the
+     * tree adds them all up, so the counts of very large inputs are
+     * scaled down until their total fits; every byte that occurs keeps a
+     * count of at least one.
+     *
+     * @return The frequencies.
+     */
+    std::vector<frequency> frequencies() const;
+
+  private:
+    /// How many times each byte value occurs
+    std::array<uint64_t, 256> counts_{};
+
+    /// How many bytes of a stream are read at a time
+    const static size_t chunk_size_ = 1 << 20;
+};
+
+#endif
@@ -38,14 +38,30 @@ int main(const std::vector<std::string>& args);
 void print_usage(const std::string& program_name);
 
 /**
- * Decodes a file using the given HuffmanTree.
+ * Decodes a file using the given HuffmanTree. The file may be a plain
+ * encoded file or a block container (see huffman_blocks.h), whose blocks
+ * are decoded in parallel.
  *
  * @param input_name Name of the file to be decompressed.
  * @param tree_name Name of the file from which to read the HuffmanTree.
  * @param output_name Name of the file to write decompressed output to.
+ * @param threads How many blocks of a container to decode at once; 0 for
+ * one per core.
  */
 void decode_file(const std::string& input_name, const std::string& tree_name,
-                const std::string& output_name);
+                const std::string& output_name, unsigned threads = 0);
+
+/**
+ * Decodes a single file Huffman stream (see huffman_stream.h), reading
+ * and writing strictly in order.
+ *
+ * @param input_name Name of the file to be decompressed, or - for
+ * standard input.
+ * @param output_name Name of the file to write decompressed output to,
+ * or - for standard output.
+ */
+void decode_stream(const std::string& input_name,
+                   const std::string& output_name);
 }
 
 #endif
@@ -9,6 +9,7 @@
 #ifndef ENCODER_H_
 #define ENCODER_H_
 
+#include <istream>
 #include <string>
 #include <vector>
 
@@ -23,6 +24,10 @@
  */
 namespace encoder
 {
+/// The longest code the encoder makes unless asked otherwise: short
+/// enough for fast table decoding, and on most inputs no limit at all
+const unsigned default_max_length = 15;
+
 /**
  * Main method of the program, should you choose to run it as a command
  * line version.
@@ -42,24 +47,92 @@ void print_usage(const std::string& programName);
 /**
  * Encodes a file using Huffman coding. Also creates the compressed
  * output of the HuffmanTree so it can be read in and used for
- * decompression.
+ * decompression. The input is read twice, once to count its characters
+ * and once to encode them, a chunk at a time, so files of any size can
+ * be encoded in a few megabytes of memory (a megabyte more for each
+ * thread counting).
  *
  * @param input_name Name of the file to be compressed.
  * @param output_name Name of the file to write compressed output.
  * @param tree_name Name of the file to write the compressed
  * HuffmanTree.
+ * @param max_length The longest code allowed, in bits; 0 for no limit.
+ * @param canonical Whether to use canonical codes and write the tree as
+ * their lengths (see huffman_tree::write_tree), which older decoders
+ * cannot read.
+ * @param threads How many chunks to count at once; 0 for one per core.
  */
 void encode_file(const std::string& input_name, const std::string& output_name,
-                 const std::string& tree_name);
+                 const std::string& tree_name,
+                 unsigned max_length = default_max_length,
+                 bool canonical = false, unsigned threads = 1);
+
+/**
+ * Encodes a file using Huffman coding into a block container (see
+ * huffman_blocks.h), whose blocks are encoded in parallel and can be
+ * decoded on their own. The tree is written as for encode_file.
+ *
+ * @param input_name Name of the file to be compressed.
+ * @param output_name Name of the container to write.
+ * @param tree_name Name of the file to write the compressed
+ * HuffmanTree.
+ * @param block_size Size of the blocks.
+ * @param threads How many chunks to count, and blocks to encode, at once;
+ * 0 for one per core.
+ * @param interleaved Whether to split each block into interleaved
+ * streams.
+ * @param max_length The longest code allowed, in bits; 0 for no limit.
+ * @param canonical Whether to use canonical codes and write the tree as
+ * their lengths.
+ */
+void encode_blocks(const std::string& input_name,
+                   const std::string& output_name,
+                   const std::string& tree_name, size_t block_size,
+                   unsigned threads, bool interleaved = false,
+                   unsigned max_length = default_max_length,
+                   bool canonical = false);
+
+/**
+ * Encodes a file using Huffman coding into a single self-describing
+ * Huffman stream (see huffman_stream.h), which needs no treefile. A
+ * file shares one code table between its blocks; standard input, which
+ * is read only once, gets one per block.
+ *
+ * @param input_name Name of the file to be compressed, or - for standard
+ * input.
+ * @param output_name Name of the file to write, or - for standard
+ * output.
+ * @param block_size Size of the blocks.
+ * @param interleaved Whether to split each block into interleaved
+ * streams.
+ * @param max_length The longest code allowed, in bits; 0 for no limit.
+ */
+void encode_stream(const std::string& input_name,
+                   const std::string& output_name, size_t block_size,
+                   bool interleaved = false,
+                   unsigned max_length = default_max_length);
 
 /**
  * Determines the frequencies of characters in a string.
  *
  * @param str The string to be searched.
  * @return A vector of frequency objects representing the frequency
- * each character in the file has.
+ * each character in the file has, in order of character.
  */
 std::vector<frequency> get_frequencies(const std::string& str);
+
+/**
+ * Determines the frequencies of characters in the rest of a stream,
+ * reading it a chunk at a time (see byte_histogram). Counts too large for
+ * a frequency are scaled down.
+ *
+ * @param input The stream to be read to its end.
+ * @param threads How many chunks to count at once; 0 for one per core.
+ * @return A vector of frequency objects representing the frequency
+ * each character in the stream has, in order of character.
+ */
+std::vector<frequency> get_frequencies(std::istream& input,
+                                       unsigned threads = 1);
 }
 
 #endif
@@ -108,6 +108,24 @@ class png
      */
     const rgba_pixel* operator()(size_t x, size_t y) const;
 
+    /**
+     * Gets a pointer to the first pixel of a row. The rest of the row
+     * follows contiguously, left to right, so whole spans of pixels can be
+     * read or written without a bounds check per pixel. Only the row
+     * index is checked.
+     * @param y Y-coordinate of the row.
+     * @return A pointer to the pixel at (0, y).
+     */
+    rgba_pixel* row(size_t y);
+
+    /**
+     * Const row access operator. Const version of the previous row().
+     * @param y Y-coordinate of the row.
+     * @return A pointer to the pixel at (0, y) (can't change the row
+     * through this pointer).
+     */
+    const rgba_pixel* row(size_t y) const;
+
     /**
      * Reads in a png image from a file.
      * Overwrites any current image content in the png. In the event of
@@ -0,0 +1,137 @@
+/**
+ * @file huffman_blocks.h
+ * Definitions for the block container format for Huffman coded files.
+ *
+ * A block container holds a file cut into blocks of block_size bytes (the
+ * last one may be shorter), each Huffman coded on its own with the same
+ * tree, so that blocks can be encoded and decoded in parallel and any one
+ * of them can be decoded without the others. The tree is kept in its own
+ * file, as for a plain encoded file.
+ *
+ * Each block is a complete binary_file_writer stream, padding byte
+ * included, and the blocks follow each other from the start of the file.
+ * After them comes the index: the length in bytes of each block's stream,
+ * then block_size, then the length of the original file, all as 8 byte
+ * big endian numbers, and last the four characters "HBLK". A plain
+ * encoded file always ends in a padding count below 8, so the two can be
+ * told apart by their last byte.
+ *
+ * In an interleaved container, which ends in "HBL4" instead, each block
+ * is made by huffman_tree::encode_interleaved: a small header with the
+ * lengths of its streams, then huffman_tree::interleaved_streams
+ * binary_file_writer streams that take the block's characters in turn,
+ * each with its own padding byte. A single core can then decode several
+ * codes at once.
+ */
+
+#ifndef HUFFMAN_BLOCKS_H_
+#define HUFFMAN_BLOCKS_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <vector>
+
+#include "huffman_tree.h"
+
+/**
+ * huffman_blocks namespace: writing, indexing and decoding block
+ * containers.
+ */
+namespace huffman_blocks
+{
+/// The last bytes of every block container with one stream per block
+const char magic[4] = {'H', 'B', 'L', 'K'};
+
+/// The last bytes of every interleaved block container
+const char interleaved_magic[4] = {'H', 'B', 'L', '4'};
+
+/// Size of the blocks the encoder makes unless asked otherwise
+const size_t default_block_size = 1 << 20;
+
+/**
+ * Where the blocks of a container are.
+ */
+struct block_index
+{
+    /// Size of every block of the original file but the last
+    uint64_t block_size;
+    /// Length of the original file
+    uint64_t length;
+    /// Whether each block is a set of interleaved streams
+    bool interleaved;
+    /// Where each block's stream starts in the container, and after them
+    /// where the index starts
+    std::vector<uint64_t> offsets;
+
+    /**
+     * @return The number of blocks.
+     */
+    size_t count() const;
+
+    /**
+     * @param block Which block.
+     * @return How many characters the block decodes to.
+     */
+    size_t block_length(size_t block) const;
+};
+
+/**
+ * Determines whether a file is a block container, from its last bytes.
+ *
+ * @param file_name The file to look at.
+ * @return Whether it ends in either magic.
+ */
+bool is_container(const std::string& file_name);
+
+/**
+ * Encodes a file into a block container. The input is read a batch of
+ * blocks at a time and the blocks of a batch are encoded concurrently.
+ *
+ * @param input_name Name of the file to be compressed.
+ * @param output_name Name of the container to write.
+ * @param tree The tree to code every block with.
+ * @param block_size Size of the blocks.
+ * @param threads How many blocks to encode at once; 0 for one per core.
+ * @param interleaved Whether to make an interleaved container.
+ */
+void encode_file(const std::string& input_name, const std::string& output_name,
+                 const huffman_tree& tree,
+                 size_t block_size = default_block_size, unsigned threads = 0,
+                 bool interleaved = false);
+
+/**
+ * Reads the index at the end of a container.
+ *
+ * @param file_name The container.
+ * @return Its index.
+ */
+block_index read_index(const std::string& file_name);
+
+/**
+ * Decodes one block of a container, reading nothing but that block.
+ *
+ * @param file_name The container.
+ * @param index Its index.
+ * @param tree The tree it was encoded with.
+ * @param block Which block to decode.
+ * @return The characters of that block of the original file.
+ */
+std::string decode_block(const std::string& file_name,
+                         const block_index& index, huffman_tree& tree,
+                         size_t block);
+
+/**
+ * Decodes a whole container, a batch of blocks at a time, with the blocks
+ * of a batch decoded concurrently.
+ *
+ * @param file_name The container.
+ * @param tree The tree it was encoded with.
+ * @param out The stream to write the original file to.
+ * @param threads How many blocks to decode at once; 0 for one per core.
+ */
+void decode_file(const std::string& file_name, const huffman_tree& tree,
+                 std::ostream& out, unsigned threads = 0);
+}
+
+#endif
@@ -0,0 +1,134 @@
+/**
+ * @file huffman_buffer.h
+ * Definitions for Huffman coding buffers in memory.
+ *
+ * These functions are meant for programs that compress small messages in
+ * process: they take the caller's buffers, touch no files, and allocate
+ * nothing on the heap but the output when they are asked to grow it. All
+ * of their working state (a byte_histogram, the code table and a decode
+ * table of (1 << max_code_length) entries) lives on the stack.
+ *
+ * A coded buffer starts with the four characters "HUFM", a mode byte and
+ * the length of the original data (8 bytes, big endian), followed by:
+ *
+ *  - mode_stored: the original data as it is, for data that would not get
+ *    any smaller (and for no data at all).
+ *  - mode_coded: the code table, as in a huffman_stream table frame (the
+ *    number of characters with a code less one, then each such character
+ *    and the length of its code, in character order), then the codes of
+ *    the data, most significant bit first, with the last byte padded with
+ *    zeros. Codes are canonical (see huffman_tree::make_canonical): the
+ *    same ones huffman_tree(lengths) gives. Data with a single distinct
+ *    character has its code stored as length 1 and no code bits.
+ *
+ * There is no checksum: decode rejects buffers whose structure is damaged
+ * (a bad header or code table, or codes that do not fill the buffer
+ * exactly), but a flipped bit among the codes or the stored data can decode
+ * to different data without an error. Callers that need to know should
+ * check the data themselves, or use a transport that does.
+ */
+
+#ifndef HUFFMAN_BUFFER_H_
+#define HUFFMAN_BUFFER_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * huffman_buffer namespace: encoding and decoding buffers in memory.
+ */
+namespace huffman_buffer
+{
+/// The first bytes of every coded buffer
+const char magic[4] = {'H', 'U', 'F', 'M'};
+
+/// Modes
+const uint8_t mode_stored = 0;
+const uint8_t mode_coded = 1;
+
+/// The longest code the encoder makes, so that one table lookup decodes
+/// any code
+const unsigned max_code_length = 12;
+
+/// The size of the header before the table or stored data
+const size_t header_size = sizeof(magic) + 1 + 8;
+
+/// The largest buffer decoding into a string makes unless told otherwise
+const uint64_t default_max_decoded_size = uint64_t(64) << 20;
+
+/**
+ * @param size The length of some data.
+ * @return The most bytes encode can make of that much data, so an
+ * output buffer this large is always large enough.
+ */
+size_t max_encoded_size(size_t size);
+
+/**
+ * Encodes data into a buffer the caller provides. Throws
+ * std::length_error, having written nothing, if it is too small.
+ *
+ * @param data The data to be compressed.
+ * @param size How many bytes it has.
+ * @param out Where to write the coded buffer.
+ * @param capacity How many bytes out has room for.
+ * @return How many bytes were written.
+ */
+size_t encode(const char* data, size_t size, uint8_t* out, size_t capacity);
+
+/**
+ * Encodes data into a vector, which is resized to exactly the coded
+ * buffer. A vector reused between calls only allocates when it has to
+ * grow.
+ *
+ * @param data The data to be compressed.
+ * @param size How many bytes it has.
+ * @param out Set to the coded buffer.
+ */
+void encode(const char* data, size_t size, std::vector<uint8_t>& out);
+
+/**
+ * Reads the length of the original data from a coded buffer's header.
+ * Throws std::runtime_error if it is not a coded buffer. The length is not
+ * checked against the rest of the buffer, which decode does before it
+ * writes anything, so it should be bounded before sizing a buffer from it.
+ *
+ * @param data The coded buffer.
+ * @param size How many bytes it has.
+ * @return How many bytes decode will write.
+ */
+uint64_t decoded_size(const uint8_t* data, size_t size);
+
+/**
+ * Decodes a coded buffer into a buffer the caller provides. Throws
+ * std::runtime_error if it is not a coded buffer or its structure is
+ * damaged, and std::length_error, having written nothing, if out is too
+ * small.
+ *
+ * @param data The coded buffer.
+ * @param size How many bytes it has.
+ * @param out Where to write the original data.
+ * @param capacity How many bytes out has room for.
+ * @return How many bytes were written.
+ */
+size_t decode(const uint8_t* data, size_t size, char* out, size_t capacity);
+
+/**
+ * Decodes a coded buffer into a string, which is resized to exactly the
+ * original data. The buffer is checked before the string is resized, so a
+ * header claiming more data than the rest of the buffer can hold throws
+ * std::runtime_error without allocating. Data with a single distinct
+ * character can decode to any length from a few bytes, so lengths over
+ * max_size throw std::length_error, also without allocating.
+ *
+ * @param data The coded buffer.
+ * @param size How many bytes it has.
+ * @param out Set to the original data.
+ * @param max_size The most bytes out may be resized to.
+ */
+void decode(const uint8_t* data, size_t size, std::string& out,
+            uint64_t max_size = default_max_decoded_size);
+}
+
+#endif
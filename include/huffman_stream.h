@@ -0,0 +1,107 @@
+/**
+ * @file huffman_stream.h
+ * Definitions for the single file Huffman stream format.
+ *
+ * A Huffman stream holds everything needed to decode it, and is written
+ * and read strictly in order, so it can go through pipes. It starts with
+ * the four characters "HUFS", a version byte and a flags byte, followed
+ * by frames, each starting with a kind byte:
+ *
+ *  - frame_table: the code table for the blocks that follow. The number
+ *    of characters with a code less one (1 byte), then each such
+ *    character and the length of its code (1 byte each), in character
+ *    order; the canonical tree with these lengths (see
+ *    huffman_tree::make_canonical) is the one the blocks use.
+ *  - frame_block: a block of the original file. Its length, then the
+ *    length of its coded bytes, then the coded bytes: one stream made by
+ *    huffman_tree::encode, or with flag_interleaved, the streams made by
+ *    huffman_tree::encode_interleaved.
+ *  - frame_end: the end of the stream. The length of the original file
+ *    and its CRC-32 (as computed by crc32) follow.
+ *
+ * All numbers are big endian; lengths take 8 bytes and the CRC 4.
+ */
+
+#ifndef HUFFMAN_STREAM_H_
+#define HUFFMAN_STREAM_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+
+#include "huffman_tree.h"
+
+/**
+ * huffman_stream namespace: encoding and decoding single file Huffman
+ * streams.
+ */
+namespace huffman_stream
+{
+/// The first bytes of every stream
+const char magic[4] = {'H', 'U', 'F', 'S'};
+
+/// Current version of the format
+const uint8_t version = 1;
+
+/// Header flag: blocks are coded as interleaved streams
+const uint8_t flag_interleaved = 0x01;
+
+/// Frame kinds
+const uint8_t frame_end = 0;
+const uint8_t frame_table = 1;
+const uint8_t frame_block = 2;
+
+/// Size of the blocks the encoder makes unless asked otherwise
+const size_t default_block_size = 1 << 20;
+
+/**
+ * Computes the CRC-32 (as used by zlib and png) of some bytes.
+ *
+ * @param data The bytes.
+ * @param size How many there are.
+ * @param crc The CRC of the bytes before these, to continue from.
+ * @return The CRC of all the bytes.
+ */
+uint32_t crc32(const char* data, size_t size, uint32_t crc = 0);
+
+/**
+ * Encodes the rest of a stream in a single pass. Each block gets a code
+ * table of its own, built from its own characters, so nothing has to be
+ * read twice.
+ *
+ * @param in The stream to be compressed.
+ * @param out The stream to write the Huffman stream to.
+ * @param block_size Size of the blocks.
+ * @param flags flag_interleaved or 0.
+ * @param max_length The longest code a table may have, in bits (see
+ * huffman_tree::limit_code_length); 0 for no limit.
+ */
+void encode(std::istream& in, std::ostream& out,
+            size_t block_size = default_block_size, uint8_t flags = 0,
+            unsigned max_length = 0);
+
+/**
+ * Encodes the rest of a stream with a single code table, which must have
+ * a code for every character the stream holds.
+ *
+ * @param in The stream to be compressed.
+ * @param out The stream to write the Huffman stream to.
+ * @param tree The tree to code every block with; it is made canonical.
+ * @param block_size Size of the blocks.
+ * @param flags flag_interleaved or 0.
+ */
+void encode(std::istream& in, std::ostream& out, huffman_tree tree,
+            size_t block_size = default_block_size, uint8_t flags = 0);
+
+/**
+ * Decodes a Huffman stream. Throws std::runtime_error if it is not one,
+ * is cut short, or does not match its length and CRC.
+ *
+ * @param in The stream to be decompressed.
+ * @param out The stream to write the original data to.
+ */
+void decode(std::istream& in, std::ostream& out);
+}
+
+#endif
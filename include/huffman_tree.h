@@ -9,7 +9,10 @@
 #ifndef HUFFMAN_TREE_H_
 #define HUFFMAN_TREE_H_
 
+#include <array>
 #include <cstddef>
+#include <cstdint>
+#include <functional>
 #include <vector>
 #include <queue>
 #include <utility>
@@ -42,13 +45,23 @@ class huffman_tree
 
     /**
      * Creates a huffman_tree from a binary file that has been written
-     * to compress the tree information.
+     * to compress the tree information. Both formats write_tree can
+     * write are read; the tree is canonical if the file was.
      *
      * @param bfile The binary file to read our compressed tree
      * information from
      */
     huffman_tree(binary_file_reader& bfile);
 
+    /**
+     * Creates the canonical huffman_tree with the given code lengths
+     * (see code_lengths). Throws std::runtime_error if they do not make
+     * a complete prefix code.
+     *
+     * @param lengths The length of each character's code, 0 for none.
+     */
+    explicit huffman_tree(const std::vector<unsigned>& lengths);
+
     /**
      * Copy constructor for Huffman Trees.
      *
@@ -91,6 +104,28 @@ class huffman_tree
      */
     std::string decode_file(binary_file_reader& bfile);
 
+    /**
+     * Decodes a given file straight into a stream. The input is read and
+     * the output written a block at a time, so this takes the same small
+     * amount of memory whatever the size of the file.
+     *
+     * @param file binary_file_reader to read bits from.
+     * @param out The stream to write the decoded contents to.
+     */
+    void decode_file(binary_file_reader& bfile, std::ostream& out);
+
+    /**
+     * Decodes a single character from the binary file. Unlike
+     * decode_file, this stops as soon as one code has been read, so
+     * Huffman codes may be mixed with other data in the same file. The
+     * code is found with one lookup in the decoding table, by peeking at
+     * the next bits.
+     *
+     * @param bfile The binary file to read the code from.
+     * @return The decoded character.
+     */
+    char decode_char(binary_file_reader& bfile);
+
     /**
      * Writes a string of data to the binary file using Huffman coding.
      *
@@ -108,12 +143,121 @@ class huffman_tree
      */
     void write(char c, binary_file_writer& bfile);
 
+    /**
+     * Huffman codes data into memory, as the bytes write would send to
+     * a binary_file_writer, padding byte included; they can be read back
+     * with a binary_file_reader. The tree is not changed, so several
+     * threads may encode with one tree at the same time.
+     *
+     * @param data The characters to be encoded.
+     * @param size How many characters there are.
+     * @param out The bytes are appended to out.
+     */
+    void encode(const char* data, size_t size, std::vector<uint8_t>& out) const;
+
+    /**
+     * Huffman codes data into memory as interleaved_streams streams: the
+     * i-th character goes to stream i % interleaved_streams, so the
+     * streams can be decoded side by side. Each stream is laid out as
+     * encode lays out a single one, padding byte included. They follow
+     * a header holding the lengths in bytes of all but the last, each as
+     * an 8 byte big endian number.
+     *
+     * @param data The characters to be encoded.
+     * @param size How many characters there are.
+     * @param out The bytes are appended to out.
+     */
+    void encode_interleaved(const char* data, size_t size,
+                            std::vector<uint8_t>& out) const;
+
+    /**
+     * Decodes the bytes encode made, from memory. Throws
+     * std::runtime_error if they do not hold exactly count codes.
+     *
+     * @param data The bytes, padding byte included.
+     * @param size How many bytes there are.
+     * @param out Where to put the characters.
+     * @param count How many characters were encoded.
+     */
+    void decode(const uint8_t* data, size_t size, char* out, size_t count);
+
+    /**
+     * Decodes the bytes encode_interleaved made. One code from each
+     * stream is decoded in turn, so their lookups do not wait on each
+     * other.
+     *
+     * @param data The bytes, header included.
+     * @param size How many bytes there are.
+     * @param out Where to put the characters.
+     * @param count How many characters were encoded.
+     */
+    void decode_interleaved(const uint8_t* data, size_t size, char* out,
+                            size_t count);
+
+    /// How many streams encode_interleaved spreads the characters over
+    const static unsigned interleaved_streams = 4;
+
+    /**
+     * Reshapes the tree into its canonical form: every character keeps
+     * the length of its code, but the codes are reassigned in order of
+     * length and then character, so the lengths alone determine the
+     * tree. Afterwards write and write_tree use the canonical codes,
+     * and write_tree can write just their lengths.
+     */
+    void make_canonical();
+
+    /**
+     * Makes sure no code is longer than max_length bits. If one is, the
+     * codes are replaced by the best ones within that length for the
+     * characters' counts (found with package-merge), and the tree is
+     * given their canonical form; otherwise nothing changes. Throws
+     * std::invalid_argument if max_length is 0, over 63, or too short
+     * for every character to have a code.
+     *
+     * @param max_length The longest code allowed, in bits.
+     */
+    void limit_code_length(unsigned max_length);
+
+    /**
+     * @return The number of bits all of the characters take with their
+     * codes, weighted by the counts in the leaves.
+     */
+    uint64_t coded_bits() const;
+
+    /**
+     * @return Whether the tree is in canonical form (see make_canonical).
+     */
+    bool canonical() const;
+
+    /**
+     * @return The length of each character's code (indexed as unsigned
+     * char), 0 for none; a lone leaf's empty code counts as 1. These are
+     * all a canonical tree needs to be rebuilt.
+     */
+    std::vector<unsigned> code_lengths() const;
+
     /**
      * Writes a compressed version of the tree to the file.
      *
+     * With as_lengths set, a canonical tree is written as its code lengths,
+     * which only decoders from the same version on can read: a 1 bit, the
+     * number of characters with a code less one (8 bits), the width w
+     * of a length less one (3 bits), and a bit choosing how the lengths
+     * follow. If it is 0, each character is listed as 8 bits followed
+     * by its length in w bits. If it is 1, all 256 lengths (0 for no
+     * code) follow in character order, each as 0 for the same as the
+     * last, 100 for one more, 101 for one less, or 11 and w bits.
+     *
+     * Otherwise the tree is written in preorder, the format every
+     * version reads: a 0 bit for an internal node and a 1 bit and the
+     * character for a leaf. That form can only start with a 1 when the
+     * tree is a lone leaf, in which case nothing follows the character.
+     *
      * @param bfile The binary file to be written to.
+     * @param as_lengths Whether to write a canonical tree as its code
+     * lengths.
      */
-    void write_tree(binary_file_writer& bfile);
+    void write_tree(binary_file_writer& bfile, bool as_lengths = false);
 
     /**
      * Prints each element in the tree in an in-order traversal.
@@ -167,6 +311,34 @@ class huffman_tree
         }
     };
 
+    /**
+     * One entry of the decoding table, which is indexed by the next
+     * table_bits_ bits of the input. Codes of at most table_bits_ bits
+     * fill every entry they are a prefix of; longer codes leave the node
+     * their first table_bits_ bits lead to, to be walked from bit by bit.
+     */
+    struct decode_entry
+    {
+        /// The node to keep walking from, for codes longer than the index
+        const node* next;
+        /// The decoded character, when length is not 0
+        char symbol;
+        /// Length of the code, or 0 if it is longer than table_bits_
+        uint8_t length;
+    };
+
+    /**
+     * A character's code as a number, high bit first, for writing with
+     * binary_file_writer::write_bits.
+     */
+    struct packed_code
+    {
+        /// The code, in the low length bits
+        uint64_t bits;
+        /// Length of the code; codes over 64 bits are written from bits_map_
+        unsigned length;
+    };
+
     /**
      * Private helper function that copies another huffman_tree.
      *
@@ -212,6 +384,40 @@ class huffman_tree
      */
     std::unique_ptr<node> read_tree(binary_file_reader& bfile);
 
+    /**
+     * Helper function used by the constructor to read the code lengths
+     * of a canonical tree (see write_tree), after its first 9 bits.
+     *
+     * @param bfile The binary file we are reading.
+     * @param count How many characters have a code.
+     * @return The length of each character's code, 0 for none.
+     */
+    std::vector<unsigned> read_lengths(binary_file_reader& bfile,
+                                       unsigned count);
+
+    /**
+     * Gives the tree the canonical shape for the given code lengths,
+     * without recursion: each code is assigned in turn and its path
+     * added to the tree. Throws std::runtime_error if the lengths do
+     * not make a complete prefix code.
+     *
+     * @param lengths The length of each character's code, 0 for none.
+     * @param counts The count to give each character's leaf.
+     */
+    void build_canonical(const std::vector<unsigned>& lengths,
+                         const std::vector<int>& counts);
+
+    /**
+     * Finds the depth and count of every leaf without recursion; a lone
+     * leaf's depth counts as 1.
+     *
+     * @param lengths Set to the length of each character's code, 0 for
+     * none.
+     * @param counts Set to the count of each character's leaf.
+     */
+    void leaf_lengths(std::vector<unsigned>& lengths,
+                      std::vector<int>& counts) const;
+
     /**
      * Recursive helper function used by the constructor to build a map
      * of characters to their encoded values based on the tree
@@ -252,14 +458,64 @@ class huffman_tree
     std::vector<bool> bits_for_char(char c);
 
     /**
-     * Helper function that recursively decodes a file by traversing
-     * the tree based on the bits read.
+     * Helper function that decodes the rest of a file. The bits are read
+     * a block at a time, and each code is found with one lookup in the
+     * table from build_table (plus a walk down the tree for long codes).
      *
-     * @param ss The stringstream being used to build the decoded
-     * output string.
      * @param bfile The binary file we are decoding.
+     * @param flush Called with each block of decoded characters, in
+     * order, as the output buffer fills.
+     */
+    void decode(binary_file_reader& bfile,
+                const std::function<void(const char*, size_t)>& flush);
+
+    /**
+     * Builds the decoding table for the current tree, which must have
+     * at least two leaves.
+     *
+     * @return The 2^table_bits_ entries of the table.
+     */
+    std::vector<decode_entry> build_table() const;
+
+    /**
+     * Helper function for the in-memory decoders: decodes count
+     * characters from streams streams, which take them in turn. One code
+     * from each stream is decoded in turn, and while all of them are well
+     * inside data, their windows are refilled eight bytes at a time.
+     *
+     * @param data The bytes holding the streams.
+     * @param bounds Where each stream starts in data, and where the last
+     * one ends.
+     * @param out Where to put the characters.
+     * @param count How many characters there are.
+     */
+    template <unsigned streams>
+    void decode_streams(const uint8_t* data, const size_t* bounds, char* out,
+                        size_t count);
+
+    /**
+     * Helper function for encode and encode_interleaved: Huffman codes
+     * every stride-th character of data, starting with the first.
+     *
+     * @param data The characters to be encoded.
+     * @param size How many characters data holds.
+     * @param stride The distance between the characters to encode.
+     * @param out The bytes are appended to out.
      */
-    void decode(std::stringstream& ss, binary_file_reader& bfile);
+    void encode_strided(const char* data, size_t size, size_t stride,
+                        std::vector<uint8_t>& out) const;
+
+    /**
+     * Recursive helper for build_table that fills in the entries for a
+     * subtree.
+     *
+     * @param current The root of the subtree.
+     * @param code The bits leading to current.
+     * @param length How many bits that is.
+     * @param table The table being filled in.
+     */
+    void fill_table(const node* current, uint32_t code, unsigned length,
+                    std::vector<decode_entry>& table) const;
 
     /**
      * Helper function to write the tree out to a binary file in a
@@ -283,9 +539,26 @@ class huffman_tree
      */
     const static int max_print_height_ = 9;
 
+    /**
+     * Number of bits the decoding table is indexed by: codes are rarely
+     * longer, and the table stays at 32KB
+     */
+    const static unsigned table_bits_ = 11;
+
+    /// How many bytes decode reads, and writes, at a time
+    const static size_t block_size_ = 1 << 16;
+
     /// Root of the tree
     std::unique_ptr<node> root_;
     /// Standard map that maps characters to their encoded values
     std::map<char, std::vector<bool>> bits_map_;
+    /// The code of every character (indexed as unsigned char), length 0
+    /// for characters without one
+    std::array<packed_code, 256> codes_{};
+    /// The decoding table (see build_table), built when first needed;
+    /// copies build their own, as it points into the tree
+    std::vector<decode_entry> table_;
+    /// Whether the tree has the canonical shape for its code lengths
+    bool canonical_ = false;
 };
 #endif
@@ -0,0 +1,116 @@
+/**
+ * @file orientation.h
+ * Definition of the orientation class, a rotation and/or mirroring of an
+ * image that is kept as a tag instead of being applied to its pixels.
+ *
+ * @date Fall 2026
+ */
+
+#ifndef ORIENTATION_H_
+#define ORIENTATION_H_
+
+#include <cstdint>
+
+namespace cs225
+{
+
+/**
+ * One of the eight symmetries of a rectangle (the dihedral group D4).
+ *
+ * The tag describes how a pixel of the displayed ("output") image is found
+ * in the stored ("tree") image: first x and y are swapped if the
+ * orientation transposes, then x is mirrored across the tree's width and
+ * y across its height as the mirror bits ask. Composing with a further
+ * rotation or flip only changes the three bits, so it is O(1) however big
+ * the image is.
+ */
+class orientation
+{
+  public:
+    /// Tag bit: output x and y are swapped.
+    static const uint8_t transpose = 0x1;
+    /// Tag bit: tree x is mirrored.
+    static const uint8_t mirror_x = 0x2;
+    /// Tag bit: tree y is mirrored.
+    static const uint8_t mirror_y = 0x4;
+
+    /**
+     * Creates an orientation from a tag (by default, the identity).
+     *
+     * @param tag Bitwise or of the tag bits above.
+     */
+    orientation(uint8_t tag = 0);
+
+    /**
+     * @return The tag bits of this orientation.
+     */
+    uint8_t tag() const;
+
+    /**
+     * @return Whether this orientation leaves every pixel in place.
+     */
+    bool identity() const;
+
+    /**
+     * Composes a clockwise quarter turn of the output image.
+     */
+    void rotate_clockwise();
+
+    /**
+     * Composes a mirror of the output image across its vertical axis.
+     */
+    void flip_horizontal();
+
+    /**
+     * Composes a mirror of the output image across its horizontal axis.
+     */
+    void flip_vertical();
+
+    /**
+     * Gives the dimensions of the output image.
+     *
+     * @param width Width of the tree image; replaced by the output width.
+     * @param height Height of the tree image; replaced by the output
+     * height.
+     */
+    void output_size(unsigned& width, unsigned& height) const;
+
+    /**
+     * Maps a pixel of the output image to the tree pixel it shows.
+     *
+     * @param x Output x coordinate; replaced by the tree x coordinate.
+     * @param y Output y coordinate; replaced by the tree y coordinate.
+     * @param width Width of the tree image.
+     * @param height Height of the tree image.
+     */
+    void tree_pixel(unsigned& x, unsigned& y, unsigned width,
+                    unsigned height) const;
+
+    /**
+     * Maps a rectangle of the tree image to the rectangle of the output
+     * image that shows it.
+     *
+     * @param x Left edge in the tree; replaced by the output left edge.
+     * @param y Top edge in the tree; replaced by the output top edge.
+     * @param w Width in the tree; replaced by the output width.
+     * @param h Height in the tree; replaced by the output height.
+     * @param width Width of the tree image.
+     * @param height Height of the tree image.
+     */
+    void output_rect(unsigned& x, unsigned& y, unsigned& w, unsigned& h,
+                     unsigned width, unsigned height) const;
+
+    /**
+     * Maps a quadrant of a square (0 northwest, 1 northeast, 2 southwest,
+     * 3 southeast) to the quadrant it ends up in.
+     *
+     * @param quadrant The quadrant in the tree.
+     * @return The quadrant in the output.
+     */
+    unsigned output_quadrant(unsigned quadrant) const;
+
+  private:
+    uint8_t tag_;
+};
+}
+#endif
@@ -0,0 +1,424 @@
+/**
+ * @file qtz.h
+ * Definitions for the .qtz serialized quadtree image format.
+ *
+ * A .qtz file is a small header followed by a preorder walk of the
+ * quadtree (children in northwest, northeast, southwest, southeast
+ * order). Nodes split as described by qtz::split, so the image can have
+ * any width and height. Every node larger than a single pixel contributes
+ * one structure bit: 1 for an internal node, 0 for a leaf. Single pixel nodes are always
+ * leaves, so their bit is implied. Each leaf is followed by its colour
+ * bytes. The whole stream is written through a binary_file_writer, so it
+ * ends with that class' usual padding byte.
+ *
+ * Streams with flag_shared can store a quadtree whose identical subtrees
+ * are shared (see quadtree::compact) without writing them out repeatedly.
+ * Every internal node's structure bit is then followed by a tag: "0" for a
+ * node written out as usual, "10" for one written out as usual that later
+ * nodes will refer back to, and "11" followed by an index for a copy of
+ * the index-th such node, whose children are not repeated. Indices take
+ * as many bits as the largest index handed out so far needs. Leaves are
+ * never shared: they cost little more than a reference would.
+ *
+ * The nodes are always stored as the tree keeps them; the header's
+ * orientation tag (see orientation.h) says how the decoded image is to be
+ * rotated or mirrored, and the decoders apply it as they go.
+ *
+ * Entropy coded streams (flag_entropy) store one Huffman tree per
+ * channel right after the header, then the root's colour, and predict
+ * every other colour from its parent's: each internal node is followed by
+ * the per channel residuals (mod 256) of its children from its own
+ * colour. An internal colour is the rounded down, area weighted average
+ * of its children, so when they all have the same area the last child
+ * only needs the remainder of that average per channel (two bits for four
+ * children, one for two) instead of a residual. Leaves carry nothing but
+ * their alpha byte, which is Huffman coded too when the stream has one.
+ *
+ * @date Fall 2026
+ */
+
+#ifndef QTZ_H_
+#define QTZ_H_
+
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "binary_file_reader.h"
+#include "binary_file_writer.h"
+#include "epng.h"
+#include "huffman_tree.h"
+#include "orientation.h"
+
+namespace cs225
+{
+
+/**
+ * qtz namespace: reading and writing of the .qtz header, and a streaming
+ * decoder that rasterises a .qtz stream without rebuilding quadtree nodes.
+ */
+namespace qtz
+{
+
+/// Current version of the format.
+const uint8_t version = 1;
+
+/// Header flag: every leaf carries an alpha byte after its rgb bytes.
+const uint8_t flag_alpha = 0x01;
+
+/// Header flag: colours are Huffman coded residuals from the parent.
+const uint8_t flag_entropy = 0x02;
+
+/// Header flag: internal nodes are tagged so repeated subtrees are written
+/// once.
+const uint8_t flag_shared = 0x04;
+
+/**
+ * The fixed fields found at the start of every .qtz stream.
+ */
+struct header
+{
+    uint32_t width;  /**< Width of the encoded image. */
+    uint32_t height; /**< Height of the encoded image. */
+    uint8_t flags;   /**< Bitwise or of the flag_ constants. */
+    /** Tag of the orientation the decoded image is shown in. */
+    uint8_t orientation;
+};
+
+/**
+ * How a node of a given size divides into children: the west and north
+ * halves take the extra pixel of an odd side, and children left without
+ * pixels (the eastern ones of a node one pixel wide, the southern ones of
+ * a node one pixel high) do not exist.
+ */
+struct split
+{
+    /**
+     * Splits a node.
+     *
+     * @param width Width of the node.
+     * @param height Height of the node.
+     */
+    split(unsigned width, unsigned height);
+
+    unsigned west;  /**< Width of the western children. */
+    unsigned east;  /**< Width of the eastern children (maybe 0). */
+    unsigned north; /**< Height of the northern children. */
+    unsigned south; /**< Height of the southern children (maybe 0). */
+
+    /**
+     * @param quadrant 0 northwest, 1 northeast, 2 southwest, 3 southeast.
+     * @return Whether that child exists.
+     */
+    bool has(unsigned quadrant) const;
+
+    /**
+     * Gives the position and size of a child.
+     *
+     * @param quadrant 0 northwest, 1 northeast, 2 southwest, 3 southeast.
+     * @param x Left edge of the node; replaced by the child's.
+     * @param y Top edge of the node; replaced by the child's.
+     * @param w Set to the width of the child.
+     * @param h Set to the height of the child.
+     */
+    void child(unsigned quadrant, unsigned& x, unsigned& y, unsigned& w,
+               unsigned& h) const;
+
+    /**
+     * @return How many children exist: 2 or 4, unless the node is a
+     * single pixel.
+     */
+    unsigned count() const;
+
+    /**
+     * @return Whether the children that exist all have the same area.
+     */
+    bool even() const;
+};
+
+/**
+ * Callback receiving decoded pixels one horizontal run at a time: the
+ * run starts at (x, y) and covers length pixels of the given colour.
+ */
+using span_sink = std::function<void(unsigned x, unsigned y, unsigned length,
+                                     const epng::rgba_pixel& color)>;
+
+/**
+ * Writes a header (magic, version, flags and dimensions).
+ *
+ * @param bfile The binary file to write to.
+ * @param hdr The header to write.
+ */
+void write_header(binary_file_writer& bfile, const header& hdr);
+
+/**
+ * Reads and validates a header. Throws std::runtime_error if the stream
+ * is not a .qtz stream this version understands.
+ *
+ * @param bfile The binary file to read from.
+ * @return The header that was read.
+ */
+header read_header(binary_file_reader& bfile);
+
+/**
+ * color_coder: writes and reads node colours in the representation the
+ * header asks for. Raw streams store every leaf colour as plain bytes;
+ * entropy coded streams store the colours of each internal node's
+ * children as Huffman coded residuals from that node's colour.
+ *
+ * Every node goes through write_root (the root only), write_children
+ * (internal nodes) or write_leaf (leaves), and the matching read
+ * functions; each representation ignores the calls it does not need.
+ */
+class color_coder
+{
+  public:
+    /// The colours of a node's children, in stream order; only the first
+    /// split::count() are used.
+    using family = std::array<epng::rgba_pixel, 4>;
+
+    /**
+     * Creates a coder for a stream with the given header.
+     *
+     * @param hdr The header of the stream.
+     */
+    color_coder(const header& hdr);
+
+    /**
+     * Whether write_codes needs the colours counted first.
+     */
+    bool entropy() const;
+
+    /**
+     * Records the colours of a node's children for the residual
+     * statistics. Every family later passed to write_children must have
+     * been counted first, as must the root and the leaves.
+     *
+     * @param parent The colour of the node.
+     * @param children The colours of its children.
+     * @param shape How the node splits.
+     */
+    void count_children(const epng::rgba_pixel& parent,
+                        const family& children, const split& shape);
+
+    /**
+     * Records the root colour for the residual statistics.
+     *
+     * @param root The colour of the root.
+     */
+    void count_root(const epng::rgba_pixel& root);
+
+    /**
+     * Records a leaf colour for the residual statistics.
+     *
+     * @param leaf The colour of the leaf.
+     */
+    void count_leaf(const epng::rgba_pixel& leaf);
+
+    /**
+     * Builds the residual codes from the counted colours and writes
+     * them. Does nothing for raw streams.
+     *
+     * @param bfile The binary file to write to.
+     */
+    void write_codes(binary_file_writer& bfile);
+
+    /**
+     * Reads the residual codes. Does nothing for raw streams.
+     *
+     * @param bfile The binary file to read from.
+     */
+    void read_codes(binary_file_reader& bfile);
+
+    /**
+     * Writes the root colour.
+     *
+     * @param bfile The binary file to write to.
+     * @param root The colour of the root.
+     */
+    void write_root(binary_file_writer& bfile, const epng::rgba_pixel& root);
+
+    /**
+     * Reads the root colour.
+     *
+     * @param bfile The binary file to read from.
+     * @return The colour of the root, as far as it is known before its
+     * leaf data is read.
+     */
+    epng::rgba_pixel read_root(binary_file_reader& bfile);
+
+    /**
+     * Writes the colours of an internal node's children. Throws
+     * std::logic_error if the node's colour is not their average.
+     *
+     * @param bfile The binary file to write to.
+     * @param parent The colour of the node.
+     * @param children The colours of its children.
+     * @param shape How the node splits.
+     */
+    void write_children(binary_file_writer& bfile,
+                        const epng::rgba_pixel& parent,
+                        const family& children, const split& shape);
+
+    /**
+     * Reads the colours of an internal node's children.
+     *
+     * @param bfile The binary file to read from.
+     * @param parent The colour of the node.
+     * @param shape How the node splits.
+     * @return The colours of its children, as far as they are known
+     * before their own data is read.
+     */
+    family read_children(binary_file_reader& bfile,
+                         const epng::rgba_pixel& parent, const split& shape);
+
+    /**
+     * Writes whatever part of a leaf's colour is not known yet.
+     *
+     * @param bfile The binary file to write to.
+     * @param leaf The colour of the leaf.
+     */
+    void write_leaf(binary_file_writer& bfile, const epng::rgba_pixel& leaf);
+
+    /**
+     * Reads whatever part of a leaf's colour is not known yet.
+     *
+     * @param bfile The binary file to read from.
+     * @param known The colour as known so far.
+     * @return The full colour of the leaf.
+     */
+    epng::rgba_pixel read_leaf(binary_file_reader& bfile,
+                               epng::rgba_pixel known);
+
+  private:
+    /// Whether leaves carry alpha
+    bool alpha_;
+    /// Whether colours are entropy coded
+    bool entropy_;
+    /// Residual histograms: red, green, blue residuals, then leaf alpha
+    std::array<std::array<int, 256>, 4> counts_;
+    /// Codes for the histograms above (entropy coded streams only)
+    std::vector<huffman_tree> codes_;
+
+    void count_residuals(const epng::rgba_pixel& color,
+                         const epng::rgba_pixel& parent);
+    void write_residuals(binary_file_writer& bfile,
+                         const epng::rgba_pixel& color,
+                         const epng::rgba_pixel& parent);
+    epng::rgba_pixel read_residuals(binary_file_reader& bfile,
+                                    const epng::rgba_pixel& parent);
+};
+
+/**
+ * The tag of an internal node in a flag_shared stream.
+ */
+enum class node_tag
+{
+    plain,    /**< Written out, never referred to again. */
+    kept,     /**< Written out, and referred to by later nodes. */
+    reference /**< A copy of an earlier kept node. */
+};
+
+/**
+ * dag_writer: decides the internal node tags of a flag_shared stream. The
+ * writer first walks the tree once with visit, then again while writing with
+ * write_tag; both walks must skip the children of any node for which the
+ * call returns false. Nodes are only used as identities and never
+ * dereferenced. When the stream does not have flag_shared, nothing is
+ * written and every node is walked.
+ */
+class dag_writer
+{
+  public:
+    /**
+     * Creates a dag_writer for a stream with the given header.
+     *
+     * @param hdr The header of the stream.
+     */
+    dag_writer(const header& hdr);
+
+    /**
+     * Records that the first walk reached a node.
+     *
+     * @param node The node reached.
+     * @return Whether the walk should continue into its children (that
+     * is, whether this is the first time the node was reached).
+     */
+    bool visit(const void* node);
+
+    /**
+     * Writes the tag of a node reached by the second walk.
+     *
+     * @param bfile The binary file to write to.
+     * @param node The node reached.
+     * @return Whether the node's children must be written (false if it
+     * was written as a reference).
+     */
+    bool write_tag(binary_file_writer& bfile, const void* node);
+
+  private:
+    /// Whether the stream has flag_shared
+    bool enabled_;
+    /// Number of times the first walk reached each node
+    std::unordered_map<const void*, unsigned> visits_;
+    /// Index of every kept node written so far
+    std::unordered_map<const void*, uint32_t> kept_;
+};
+
+/**
+ * dag_reader: reads the internal node tags of a flag_shared stream. When
+ * the stream does not have flag_shared, every node is plain.
+ */
+class dag_reader
+{
+  public:
+    /**
+     * Creates a dag_reader for a stream with the given header.
+     *
+     * @param hdr The header of the stream.
+     */
+    dag_reader(const header& hdr);
+
+    /**
+     * Reads the tag of an internal node, after its structure bit.
+     *
+     * @param bfile The binary file to read from.
+     * @param index Set to the index of a kept node, or of the node a
+     * reference copies.
+     * @return The tag.
+     */
+    node_tag read_tag(binary_file_reader& bfile, uint32_t& index);
+
+  private:
+    /// Whether the stream has flag_shared
+    bool enabled_;
+    /// Number of kept nodes read so far
+    uint32_t kept_;
+};
+
+/**
+ * Decodes the node stream that follows a header, handing every leaf to
+ * the sink as a series of row spans, in the coordinates of the oriented
+ * image. No quadtree nodes are built: the decoder only keeps the stack of
+ * width x height rectangles still waiting to be read.
+ *
+ * @param bfile The binary file to read from, positioned after the header.
+ * @param hdr The header that was read from bfile.
+ * @param sink Receives the decoded spans.
+ */
+void decode(binary_file_reader& bfile, const header& hdr,
+            const span_sink& sink);
+
+/**
+ * Decodes a .qtz file straight into an image.
+ *
+ * @param file_name The file to decode.
+ * @return The decoded image.
+ */
+epng::png decode(const std::string& file_name);
+}
+}
+#endif
@@ -9,7 +9,14 @@
 #define QUADTREE_H_
 
 #include <iostream>
+#include <memory>
+#include <unordered_map>
+#include <utility>
+#include <vector>
 #include "epng.h"
+#include "orientation.h"
+#include "row_reader.h"
+#include "qtz.h"
 
 namespace cs225
 {
@@ -21,61 +28,184 @@ class quadtree
 {
   public:
 	quadtree();
+	// the whole image, a d x d square or a width x height rectangle of it;
+	// sides need not be powers of two (nodes split as qtz::split says)
+	quadtree(const epng::png& source);
 	quadtree(const epng::png& source, unsigned d);
+	quadtree(const epng::png& source, unsigned width, unsigned height);
+	// the whole image, read from a png file band_rows rows at a time: each
+	// subtree is built as soon as its rows are in, so only the tree and one
+	// band of pixels are held in memory. rows must not have been read yet
+	quadtree(epng::row_reader& rows, unsigned band_rows = 64);
 	quadtree(const quadtree& other);
 	quadtree(quadtree&& other);
 	~quadtree() = default;
 	
 	void swap(quadtree& other);
 	quadtree& operator=(quadtree other);
+	void build_tree(const epng::png& source);
 	void build_tree(const epng::png& source, unsigned d);
+	void build_tree(const epng::png& source, unsigned width, unsigned height);
+	void build_tree(epng::row_reader& rows, unsigned band_rows = 64);
 	const epng::rgba_pixel& operator() (unsigned x, unsigned y) const;
+	// the pixels at many (x, y) points at once, in the same order; points
+	// in the same part of the image share the walk down to it
+	std::vector<epng::rgba_pixel> sample(const std::vector<std::pair<unsigned, unsigned>>& points)const;
 	epng::png decompress()const;
+	// decode only the w x h region at (x, y); the scaled version samples
+	// it every 2^scale pixels, reading no deeper than nodes of that size
+	epng::png decompress_region(unsigned x, unsigned y, unsigned w, unsigned h)const;
+	epng::png decompress_scaled(unsigned x, unsigned y, unsigned w, unsigned h,
+				    unsigned scale)const;
 
+	// rotations and flips only update orientation_, which decompress,
+	// operator() and write apply on the fly; materialize() rearranges the
+	// nodes to match it and resets it (rebuilding the tree when a mirrored
+	// side is not a power of two)
 	void rotate_clockwise();
+	void flip_horizontal();
+	void flip_vertical();
+	void materialize();
 
+	// merges identical subtrees so each is stored once; the tree is then a
+	// DAG, which copy-on-write keeps correct when it is pruned or rotated.
+	// write with qtz::flag_shared to keep the sharing in the file too
+	void compact();
+
+	// on large trees both work through the top quadrants concurrently; the
+	// result is the same as a serial pass
 	void prune(unsigned tolerance);
 	uint64_t pruned_size(unsigned tolerance)const;
 	uint32_t ideal_prune(unsigned leaves)const;
 
+	// .qtz serialisation, see qtz.h for the format. flags may ask for
+	// qtz::flag_entropy; the alpha flag is worked out from the leaves.
+	void write(binary_file_writer& bfile, uint8_t flags = 0)const;
+	void read(binary_file_reader& bfile);
+	void save(const std::string& file_name, uint8_t flags = 0)const;
+	void load(const std::string& file_name);
+
   private:
+    /**
+     * The part of the output image being decoded by decompress_region and
+     * decompress_scaled: output pixel (i, j) shows source pixel
+     * (x + i * 2^shift, y + j * 2^shift).
+     */
+    struct region
+    {
+	unsigned x, y, w, h;
+	unsigned shift;
+    };
+
+    struct intern_table;
+
+    // a point being looked up by sample(), in tree coordinates
+    struct sample_point
+    {
+	unsigned x, y;
+	uint32_t index; // where its colour goes in the output
+    };
+
     /**
      * A simple class representing a single node of a quadtree.
-     * You may want to add to this class; in particular, it could
-     * probably use a constructor or two...
+     * Nodes do not store their size: it follows from the tree's
+     * dimensions and the node's position, so the traversals pass it down.
+     * Children that would have no pixels are null; northwest never is.
      */
     class node
     {
       public:
 	node() = default;
-	node(node &other);
-	node(unsigned x, unsigned y, unsigned length);
-	node(const epng::png& source, unsigned x, unsigned y, unsigned length);
+	node(const node& other) = default; // shallow: the copy shares the children
+	node(const epng::png& source, unsigned x, unsigned y, unsigned w, unsigned h);
+
+	// 0 northwest, 1 northeast, 2 southwest, 3 southeast
+	std::shared_ptr<node>& child(unsigned quadrant);
+	const std::shared_ptr<node>& child(unsigned quadrant)const;
+
+	void average_children(unsigned w, unsigned h);
+	qtz::color_coder::family children_colors()const;
+	void count_colors(qtz::color_coder& coder, qtz::dag_writer& dag,
+			  unsigned w, unsigned h)const;
+	void write_node(binary_file_writer& bfile, qtz::color_coder& coder,
+			qtz::dag_writer& dag, unsigned w, unsigned h)const;
+	static auto read_node(binary_file_reader& bfile, qtz::color_coder& coder,
+			      qtz::dag_reader& dag, std::vector<std::shared_ptr<node>>& kept,
+			      const epng::rgba_pixel& known, unsigned w, unsigned h) ->std::shared_ptr<node>;
+	bool has_alpha()const;
 	
-	void colorFiller(epng::png& output, unsigned x, unsigned y);
-	auto nodeFinder(unsigned x, unsigned y)const ->node*;
+	// (x, y, w, h) is this node's rectangle, (width, height) the tree's
+	void colorFiller(epng::png& output, unsigned x, unsigned y, unsigned w, unsigned h,
+			 const orientation& o, unsigned width, unsigned height)const;
+	void regionFiller(epng::png& output, unsigned x, unsigned y, unsigned w, unsigned h,
+			  const region& r, const orientation& o, unsigned width,
+			  unsigned height)const;
+	auto nodeFinder(unsigned x, unsigned y, unsigned w, unsigned h)const ->const node*;
+	void sampleFinder(sample_point* first, sample_point* last, unsigned x, unsigned y,
+			  unsigned w, unsigned h, epng::rgba_pixel* out)const;
 
-	void rotate_node_clockwise();
-	void node_prune(unsigned tolerance, int& pruned_size);//if pruned_size == -1, we do actually prune, and don't worry about the pruned_size value.
+	// nodes are shared between copies of a tree; these change the subtree
+	// held by slot, copying shared nodes first (see unshare)
+	static node* unshare(std::shared_ptr<node>& slot);
+	static void reorient(std::shared_ptr<node>& slot, const orientation& o);
+	// merges every subtree of one pixel, alpha included, into a leaf; only
+	// for nodes no other tree shares. Returns whether this node is a leaf
+	bool merge_uniform();
+	// the top parallel levels prune their quadrants on separate tasks
+	static void node_prune(std::shared_ptr<node>& slot, unsigned tolerance,
+			       unsigned parallel);
+	static void intern(std::shared_ptr<node>& slot, intern_table& table,
+			   unsigned w, unsigned h);
 	
 	bool all_child_check(const node*, unsigned, bool)const;
 	bool check_tolerance(const node*, unsigned)const;
-	void prunnable(unsigned tolerance, unsigned& count);
+	uint64_t prunnable(unsigned tolerance, unsigned parallel)const;
 
-        std::unique_ptr<node> northwest;
-        std::unique_ptr<node> northeast;
-        std::unique_ptr<node> southwest;
-        std::unique_ptr<node> southeast;
+        std::shared_ptr<node> northwest;
+        std::shared_ptr<node> northeast;
+        std::shared_ptr<node> southwest;
+        std::shared_ptr<node> southeast;
 
         epng::rgba_pixel element; // the pixel stored as this node's "data"
+    };
+
+    /**
+     * What makes two nodes interchangeable for compact(): the same colour,
+     * size and (already interned) children.
+     */
+    struct node_key
+    {
+	uint32_t color;
+	unsigned width, height;
+	const node* children[4];
+	bool operator==(const node_key& other)const;
+    };
 
-	unsigned length_;
+    struct node_key_hash
+    {
+	size_t operator()(const node_key& key)const;
+    };
 
+    struct intern_table
+    {
+	std::unordered_map<node_key, std::shared_ptr<node>, node_key_hash> nodes;
+	// every node already visited, mapped to the node replacing it; the keys
+	// also keep replaced nodes alive so their addresses are not reused
+	std::unordered_map<std::shared_ptr<node>, std::shared_ptr<node>> done;
     };
 
-    std::unique_ptr<node> root_; // the root of the tree
+    std::shared_ptr<node> root_; // the root of the tree, possibly shared with copies
+
+	epng::png decompress(const region& r)const;
+
+	// streaming build: reads the next h rows and returns the nodes covering
+	// them, one per column (x, width) of their level, null for empty columns
+	auto build_rows(epng::row_reader& rows, epng::png& band, unsigned band_rows,
+			const std::vector<std::pair<unsigned, unsigned>>& columns,
+			unsigned h) ->std::vector<std::shared_ptr<node>>;
 
-	unsigned res_;
+	unsigned width_, height_; // of the stored image
+	orientation orientation_; // how the stored image is shown
 /**** Do not remove this line or copy its contents here! ****/
 #include "quadtree_given.h"
 };
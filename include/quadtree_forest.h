@@ -0,0 +1,161 @@
+/**
+ * @file quadtree_forest.h
+ * Definition of the quadtree_forest class, a tiled quadtree for images too
+ * large to hold in memory.
+ *
+ * @date Fall 2026
+ */
+
+#ifndef QUADTREE_FOREST_H_
+#define QUADTREE_FOREST_H_
+
+#include <cstdint>
+#include <fstream>
+#include <list>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "epng.h"
+#include "quadtree.h"
+
+namespace cs225
+{
+
+/**
+ * A forest of quadtrees, one per square tile of an image (tiles on the
+ * right and bottom edges may be smaller). The image is read from its png
+ * file one band of tiles at a time, and every tile's tree is stored as a
+ * .qtz stream in a backing file. At most max_resident trees are kept in
+ * memory; the others are read back from the backing file when they are
+ * needed and dropped again, least recently used first. A tree that
+ * pruning changed is written back before it is dropped, as a new stream
+ * at the end of the backing file; once the streams it supersedes take up
+ * more of the file than the newest ones, the file is compacted.
+ *
+ * Each tile is pruned on its own, so pruning never merges pixels across
+ * tile edges.
+ */
+class quadtree_forest
+{
+  public:
+    /**
+     * Builds the forest of a png file. Only one band of tile rows of the
+     * image is held in memory at a time.
+     *
+     * @param png_file The image, which must not be interlaced.
+     * @param backing_file File to store the trees in; it is replaced.
+     * @param tile Side of the tiles.
+     * @param max_resident Most trees kept in memory at once (at least 1).
+     */
+    quadtree_forest(const std::string& png_file,
+                    const std::string& backing_file, unsigned tile = 512,
+                    size_t max_resident = 16);
+
+    /**
+     * @return Width of the image.
+     */
+    unsigned width() const;
+
+    /**
+     * @return Height of the image.
+     */
+    unsigned height() const;
+
+    /**
+     * @return Number of tiles.
+     */
+    size_t tile_count() const;
+
+    /**
+     * @return Number of trees currently in memory.
+     */
+    size_t resident() const;
+
+    /**
+     * Prunes every tile's tree, as quadtree::prune does.
+     *
+     * @param tolerance The largest difference allowed within a leaf.
+     */
+    void prune(unsigned tolerance);
+
+    /**
+     * Counts the leaves the forest would have if it were pruned, as
+     * quadtree::pruned_size does.
+     *
+     * @param tolerance The largest difference allowed within a leaf.
+     * @return Total number of leaves over all tiles.
+     */
+    uint64_t pruned_size(unsigned tolerance);
+
+    /**
+     * Decodes part of the image. Only the tiles the region touches are
+     * read, and those that are not in memory are decoded straight from
+     * the backing file without being paged in.
+     *
+     * @param x Left edge of the region.
+     * @param y Top edge of the region.
+     * @param w Width of the region.
+     * @param h Height of the region.
+     * @return The pixels of the region.
+     */
+    epng::png decompress_region(unsigned x, unsigned y, unsigned w,
+                                unsigned h);
+
+  private:
+    /**
+     * One tile: where it is in the image and in the backing file, and its
+     * tree while it is in memory.
+     */
+    struct tile_entry
+    {
+        unsigned x, y, w, h;
+        std::streamoff offset; // of its newest stream in the backing file
+        std::streamoff length;
+        std::unique_ptr<quadtree> tree; // null unless resident
+        bool dirty;                     // changed since it was stored
+        std::list<size_t>::iterator lru;
+    };
+
+    /// File the trees are stored in
+    std::string backing_;
+    /// Size of the backing file
+    std::streamoff backing_size_;
+    /// Bytes of the backing file taken by superseded streams
+    std::streamoff dead_;
+    /// Dimensions of the image
+    unsigned width_, height_;
+    /// Side of the tiles
+    unsigned tile_;
+    /// Most trees kept in memory at once
+    size_t max_resident_;
+    /// Tiles in row major order
+    std::vector<tile_entry> tiles_;
+    /// Resident tiles, most recently used first
+    std::list<size_t> lru_;
+
+    /**
+     * Appends a tree to the backing file as the given tile's newest
+     * stream.
+     */
+    void store(tile_entry& entry, const quadtree& tree);
+
+    /**
+     * Rewrites the backing file with only each tile's newest stream.
+     */
+    void compact();
+
+    /**
+     * Gets a tile's tree, reading it from the backing file if needed,
+     * and marks it most recently used.
+     */
+    quadtree& page_in(size_t index);
+
+    /**
+     * Makes a tree resident and drops the least recently used ones past
+     * max_resident_.
+     */
+    void make_resident(size_t index, std::unique_ptr<quadtree> tree);
+};
+}
+#endif
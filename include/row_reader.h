@@ -0,0 +1,81 @@
+/**
+ * @file row_reader.h
+ * Definition of the row_reader class, which reads a png file one row at a
+ * time instead of loading the whole image.
+ *
+ * @date Fall 2026
+ */
+
+#ifndef EPNG_ROW_READER_H_
+#define EPNG_ROW_READER_H_
+
+#include <cstddef>
+#include <memory>
+#include <string>
+
+#include "rgba_pixel.h"
+
+namespace epng
+{
+
+/**
+ * Reads the rows of a png file from top to bottom, converting them to
+ * rgba_pixels the same way png::load does. Only one row of the file is
+ * held in memory at a time, so images too large to load can still be
+ * processed. Interlaced files cannot be read this way.
+ */
+class row_reader
+{
+  public:
+    /**
+     * Opens a png file and reads its header. Throws std::runtime_error if
+     * the file cannot be read or is interlaced.
+     *
+     * @param file_name Name of the file to be read.
+     */
+    row_reader(const std::string& file_name);
+
+    /**
+     * Closes the file.
+     */
+    ~row_reader();
+
+    row_reader(const row_reader&) = delete;
+    row_reader& operator=(const row_reader&) = delete;
+
+    /**
+     * Gets the width of the image.
+     * @return Width of the image.
+     */
+    size_t width() const;
+
+    /**
+     * Gets the height of the image.
+     * @return Height of the image.
+     */
+    size_t height() const;
+
+    /**
+     * Gets how many rows have been read so far.
+     * @return The y-coordinate of the next row.
+     */
+    size_t rows_read() const;
+
+    /**
+     * Reads the next row of the image. Throws std::out_of_range if every
+     * row has been read, and std::runtime_error if the file is corrupt.
+     *
+     * @param out Where to store the row; must have room for width()
+     * pixels.
+     */
+    void read_row(rgba_pixel* out);
+
+  private:
+    struct impl;
+    std::unique_ptr<impl> impl_;
+    size_t width_;
+    size_t height_;
+    size_t rows_read_;
+};
+}
+#endif
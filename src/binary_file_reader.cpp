@@ -6,21 +6,45 @@
  * @date Summer 2012
  */
 
+#include <algorithm>
+#include <cstring>
 #include <iostream>
 #include "binary_file_reader.h"
 
 binary_file_reader::binary_file_reader(const std::string& fileName)
     : file{fileName, std::ios::binary},
-      current_byte_{'\0'},
-      current_bit_{-1},
-      num_read_{0}
+      start_{0},
+      bits_read_{0},
+      block_pos_{0},
+      bytes_loaded_{0},
+      window_{0},
+      window_bits_{0}
 {
     file.seekg(-1, std::ios::end);
     max_bytes_ = file.tellg();
     padding_bits_ = static_cast<int8_t>(file.get());
+    total_bits_ = max_bytes_ * 8 - padding_bits_;
     file.seekg(0, std::ios::beg);
 }
 
+binary_file_reader::binary_file_reader(const std::string& fileName,
+                                       std::streamoff offset,
+                                       std::streamoff length)
+    : file{fileName, std::ios::binary},
+      start_{offset},
+      max_bytes_{length - 1},
+      bits_read_{0},
+      block_pos_{0},
+      bytes_loaded_{0},
+      window_{0},
+      window_bits_{0}
+{
+    file.seekg(offset + length - 1, std::ios::beg);
+    padding_bits_ = static_cast<int8_t>(file.get());
+    total_bits_ = max_bytes_ * 8 - padding_bits_;
+    file.seekg(offset, std::ios::beg);
+}
+
 binary_file_reader::~binary_file_reader()
 {
     close();
@@ -34,47 +58,124 @@ void binary_file_reader::close()
 
 bool binary_file_reader::has_bits() const
 {
-    return (num_read_ != max_bytes_) || (current_bit_ >= padding_bits_);
+    return bits_read_ < total_bits_;
 }
 
 bool binary_file_reader::has_bytes() const
 {
-    return (num_read_ != max_bytes_) || current_bit_ == 7;
+    return bits_left() >= 8;
+}
+
+std::streamoff binary_file_reader::bits_left() const
+{
+    return total_bits_ - bits_read_;
 }
 
 bool binary_file_reader::next_bit()
 {
-    if (needs_next_byte())
-        read_next_byte();
-    bool ret = ((current_byte_ >> current_bit_) & 1) == 1;
-    --current_bit_;
+    bool ret = peek_bits(1) != 0;
+    consume(1);
     return ret;
 }
 
 uint8_t binary_file_reader::next_byte()
 {
-    uint8_t ret = 0;
-    for (int currBit = 0; currBit < 8 && has_bits(); ++currBit)
-        ret = ret | next_bit() << (7 - currBit);
+    // past the end the missing low bits are 0
+    uint8_t ret = static_cast<uint8_t>(peek_bits(8));
+    consume(static_cast<unsigned>(std::min<std::streamoff>(8, bits_left())));
     return ret;
 }
 
-bool binary_file_reader::needs_next_byte() const
+uint64_t binary_file_reader::peek_bits(unsigned n)
 {
-    return current_bit_ == -1;
+    if (n == 0)
+        return 0;
+    if (window_bits_ < n)
+        fill_window();
+    return window_ >> (64 - n);
 }
 
-void binary_file_reader::read_next_byte()
+void binary_file_reader::consume(unsigned n)
 {
-    // read a single byte
-    file.read(reinterpret_cast<char*>(&current_byte_), 1);
-    current_bit_ = 7;
-    ++num_read_;
+    if (n == 0)
+        return;
+    if (window_bits_ < n)
+        fill_window();
+    window_ = n == 64 ? 0 : window_ << n;
+    window_bits_ -= std::min(n, window_bits_);
+    bits_read_ += n;
+}
+
+void binary_file_reader::read_bytes(uint8_t* out, std::streamoff count)
+{
+    // whatever whole bytes the window has first; off a byte boundary
+    // every byte has to come through the window, 7 at a time
+    while (count > 0 && (window_bits_ >= 8 || bits_read_ % 8 != 0))
+    {
+        if (count >= 7)
+        {
+            uint64_t bits = peek_bits(56);
+            consume(56);
+            for (int shift = 48; shift >= 0; shift -= 8)
+                *out++ = static_cast<uint8_t>(bits >> shift);
+            count -= 7;
+            continue;
+        }
+        *out++ = next_byte();
+        --count;
+    }
+    if (count <= 0)
+        return;
+
+    // at a byte boundary with an empty window: copy the rest of the block,
+    // then read straight from the file
+    std::streamoff from_block = std::min<std::streamoff>(
+        count, block_.size() - block_pos_);
+    if (from_block > 0)
+        std::memcpy(out, block_.data() + block_pos_, from_block);
+    block_pos_ += from_block;
+    out += from_block;
+    count -= from_block;
+    if (count > 0)
+    {
+        file.read(reinterpret_cast<char*>(out), count);
+        bytes_loaded_ += count;
+    }
+    bits_read_ += (from_block + count) * 8;
+}
+
+void binary_file_reader::fill_window()
+{
+    while (window_bits_ <= 56)
+    {
+        if (block_pos_ == block_.size() && !read_block())
+            return; // past the end: the rest of the window stays 0
+        window_ |= uint64_t(block_[block_pos_++]) << (56 - window_bits_);
+        window_bits_ += 8;
+    }
+}
+
+bool binary_file_reader::read_block()
+{
+    std::streamoff size = std::min<std::streamoff>(block_size_,
+                                                   max_bytes_ - bytes_loaded_);
+    if (size <= 0)
+        return false;
+    block_.resize(size);
+    file.read(reinterpret_cast<char*>(block_.data()), size);
+    bytes_loaded_ += size;
+    block_pos_ = 0;
+    return true;
 }
 
 void binary_file_reader::reset()
 {
-    file.seekg(0, std::ios::beg);
-    current_bit_ = -1;
-    current_byte_ = '\0';
+    file.clear();
+    file.seekg(start_, std::ios::beg);
+    bits_read_ = 0;
+    block_.clear();
+    block_pos_ = 0;
+    bytes_loaded_ = 0;
+    window_ = 0;
+    window_bits_ = 0;
 }
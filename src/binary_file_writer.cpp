@@ -12,9 +12,17 @@
 using namespace std;
 
 binary_file_writer::binary_file_writer(const std::string& fileName)
-    : file(fileName, ios::binary), current_byte_('\0'), current_bit_(7)
+    : file(fileName, ios::binary), word_(0), word_bits_(0)
 {
-    /* nothing */
+    buffer_.reserve(buffer_size_);
+}
+
+binary_file_writer::binary_file_writer(const std::string& fileName, bool append)
+    : file(fileName, append ? ios::binary | ios::app : ios::binary),
+      word_(0),
+      word_bits_(0)
+{
+    buffer_.reserve(buffer_size_);
 }
 
 binary_file_writer::~binary_file_writer()
@@ -26,40 +34,61 @@ void binary_file_writer::close()
 {
     if (!file.is_open())
         return;
-    if (current_bit_ != 7)
-    {
-        auto padding_as_char = static_cast<uint8_t>(current_bit_ + 1);
-        // write out the last partial byte
-        write_current_byte_();
-        current_byte_ = padding_as_char;
-        write_current_byte_();
-    }
-    else
-    {
-        // write out number of padding bits (0 in this case)
-        current_byte_ = 0;
-        write_current_byte_();
-    }
+    // the whole bytes of the last word, then the last partial byte
+    // (padded with zeros), then the number of padding bits
+    unsigned padding = (8 - word_bits_ % 8) % 8;
+    uint64_t last = word_ << padding;
+    for (unsigned bits = word_bits_ + padding; bits > 0; bits -= 8)
+        buffer_.push_back(static_cast<char>(last >> (bits - 8)));
+    buffer_.push_back(static_cast<char>(padding));
+    flush_buffer_();
+    word_ = 0;
+    word_bits_ = 0;
     file.close();
 }
 
 void binary_file_writer::write_bit(bool bit)
 {
-    current_byte_ = current_byte_ | (static_cast<uint8_t>(bit) << current_bit_);
-    --current_bit_;
-    if (current_bit_ == -1)
-        write_current_byte_();
+    write_bits(bit, 1);
 }
 
 void binary_file_writer::write_byte(uint8_t byte)
 {
-    for (int i = 0; i < 8; ++i)
-        write_bit(((byte >> (7 - i)) & 1) == 1);
+    write_bits(byte, 8);
+}
+
+void binary_file_writer::write_bits(uint64_t value, unsigned count)
+{
+    if (count == 0)
+        return;
+    if (count < 64)
+        value &= (uint64_t(1) << count) - 1;
+    unsigned room = 64 - word_bits_;
+    if (count < room)
+    {
+        word_ = word_ << count | value;
+        word_bits_ += count;
+        return;
+    }
+
+    // fill up the word with the high bits of value and keep the rest
+    unsigned rest = count - room;
+    uint64_t high = value >> rest;
+    write_word_(room == 64 ? high : word_ << room | high);
+    word_ = rest == 0 ? 0 : value & ((uint64_t(1) << rest) - 1);
+    word_bits_ = rest;
+}
+
+void binary_file_writer::write_word_(uint64_t word)
+{
+    for (int shift = 56; shift >= 0; shift -= 8)
+        buffer_.push_back(static_cast<char>(word >> shift));
+    if (buffer_.size() >= buffer_size_)
+        flush_buffer_();
 }
 
-void binary_file_writer::write_current_byte_()
+void binary_file_writer::flush_buffer_()
 {
-    current_bit_ = 7;
-    file.write(reinterpret_cast<char*>(&current_byte_), 1);
-    current_byte_ = '\0';
+    file.write(buffer_.data(), buffer_.size());
+    buffer_.clear();
 }
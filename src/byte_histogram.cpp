@@ -0,0 +1,105 @@
+/**
+ * @file byte_histogram.cpp
+ * Implementation of a class for counting the bytes of large inputs.
+ */
+
+#include <algorithm>
+#include <cstring>
+#include <future>
+#include <limits>
+#include <thread>
+
+#include "byte_histogram.h"
+
+using namespace std;
+
+void byte_histogram::add(const char* data, size_t size)
+{
+    // eight bytes are loaded at once and spread over four tables, so an
+    // increment never has to wait for the one just before it
+    uint64_t tables[4][256] = {};
+    size_t i = 0;
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        ++tables[0][word & 0xff];
+        ++tables[1][word >> 8 & 0xff];
+        ++tables[2][word >> 16 & 0xff];
+        ++tables[3][word >> 24 & 0xff];
+        ++tables[0][word >> 32 & 0xff];
+        ++tables[1][word >> 40 & 0xff];
+        ++tables[2][word >> 48 & 0xff];
+        ++tables[3][word >> 56];
+    }
+    for (; i < size; ++i)
+        ++tables[0][static_cast<uint8_t>(data[i])];
+
+    for (size_t c = 0; c < counts_.size(); ++c)
+        counts_[c] += tables[0][c] + tables[1][c] + tables[2][c] + tables[3][c];
+}
+
+void byte_histogram::add(istream& input, unsigned threads)
+{
+    if (threads == 0)
+        threads = max(1u, thread::hardware_concurrency());
+
+    // the first chunk of a batch is counted on this thread and the others
+    // each on their own, into histograms of their own
+    vector<vector<char>> batch(threads, vector<char>(chunk_size_));
+    vector<byte_histogram> parts(threads);
+    bool done = false;
+    while (!done)
+    {
+        vector<size_t> sizes;
+        while (sizes.size() < threads && !done)
+        {
+            input.read(batch[sizes.size()].data(), chunk_size_);
+            size_t size = input.gcount();
+            if (size)
+                sizes.push_back(size);
+            done = size < chunk_size_;
+        }
+
+        vector<future<void>> counted;
+        for (size_t i = 1; i < sizes.size(); ++i)
+            counted.push_back(async(launch::async, [&, i]
+            {
+                parts[i].add(batch[i].data(), sizes[i]);
+            }));
+        if (!sizes.empty())
+            add(batch[0].data(), sizes[0]);
+        for (auto& part : counted)
+            part.get();
+    }
+    for (size_t i = 1; i < parts.size(); ++i)
+        merge(parts[i]);
+}
+
+void byte_histogram::merge(const byte_histogram& other)
+{
+    for (size_t c = 0; c < counts_.size(); ++c)
+        counts_[c] += other.counts_[c];
+}
+
+const array<uint64_t, 256>& byte_histogram::counts() const
+{
+    return counts_;
+}
+
+vector<frequency> byte_histogram::frequencies() const
+{
+    uint64_t total = 0;
+    for (auto count : counts_)
+        total += count;
+    const uint64_t limit = numeric_limits<int>::max() / 2;
+    uint64_t divisor = total > limit ? total / limit + 1 : 1;
+
+    vector<frequency> result;
+    for (size_t c = 0; c < counts_.size(); ++c)
+        if (counts_[c])
+            result.push_back(frequency(
+                static_cast<char>(c),
+                static_cast<int>(max<uint64_t>(counts_[c] / divisor, 1))));
+    return result;
+}
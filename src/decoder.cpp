@@ -6,42 +6,100 @@
  * @date Summer 2012
  */
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 
 #include "binary_file_reader.h"
 #include "decoder.h"
+#include "huffman_blocks.h"
+#include "huffman_stream.h"
 #include "huffman_tree.h"
 
 using namespace std;
 
 int decoder::main(const vector<string>& args)
 {
-    if (args.size() < 4)
+    unsigned threads = 0;
+    vector<string> names;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "--threads" && i + 1 < args.size())
+            threads = stoul(args[++i]);
+        else
+            names.push_back(args[i]);
+    }
+    if (names.size() == 2)
+    {
+        if (names[0] == "-" || names[1] == "-")
+            ios::sync_with_stdio(false);
+        decode_stream(names[0], names[1]);
+        return 0;
+    }
+    if (names.size() != 3)
     {
         print_usage(args[0]);
         return -1;
     }
-    decode_file(args[1], args[2], args[3]);
+    decode_file(names[0], names[1], names[2], threads);
     return 0;
 }
 
 void decoder::print_usage(const string& programName)
 {
     cout << "Usage: " << endl;
-    cout << "\t" << programName << " input treefile output" << endl;
+    cout << "\t" << programName << " [--threads n] input treefile output"
+         << endl;
     cout << "\t\tinput: file to be decoded" << endl;
     cout << "\t\ttreefile: compressed huffman tree to use for decoding" << endl;
     cout << "\t\toutput: decompressed file" << endl;
+    cout << "\t\t--threads: blocks of a block container to decode at once"
+         << endl;
+    cout << "\t\t\t(default one per core)" << endl;
+    cout << "\t" << programName << " input output" << endl;
+    cout << "\t\tdecodes a single file Huffman stream; input and output may"
+         << endl;
+    cout << "\t\tbe - for stdin and stdout" << endl;
 }
 
 void decoder::decode_file(const string& input_name, const string& tree_name,
-                          const string& output_name)
+                          const string& output_name, unsigned threads)
 {
-    binary_file_reader input(input_name);
     binary_file_reader treeIn(tree_name);
     huffman_tree tree(treeIn);
 
-    ofstream output(output_name);
-    output << tree.decode_file(input);
+    ofstream output(output_name, ios::binary);
+    if (huffman_blocks::is_container(input_name))
+    {
+        huffman_blocks::decode_file(input_name, tree, output, threads);
+        return;
+    }
+    binary_file_reader input(input_name);
+    // encode_file writes each character of a lone leaf as a 0 bit
+    vector<unsigned> lengths = tree.code_lengths();
+    auto lone = find(lengths.begin(), lengths.end(), 1);
+    if (size_t(count(lengths.begin(), lengths.end(), 0)) + 1 == lengths.size())
+    {
+        string chunk(1 << 16, static_cast<char>(lone - lengths.begin()));
+        for (streamoff left = input.bits_left(); left > 0;)
+        {
+            streamoff size = min<streamoff>(left, chunk.size());
+            output.write(chunk.data(), size);
+            left -= size;
+        }
+        return;
+    }
+    tree.decode_file(input, output);
+}
+
+void decoder::decode_stream(const string& input_name, const string& output_name)
+{
+    ifstream input_file;
+    if (input_name != "-")
+        input_file.open(input_name, ios::binary);
+    ofstream output_file;
+    if (output_name != "-")
+        output_file.open(output_name, ios::binary);
+    huffman_stream::decode(input_name == "-" ? cin : input_file,
+                           output_name == "-" ? cout : output_file);
 }
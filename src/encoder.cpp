@@ -6,46 +6,151 @@
  * @date Summer 2012
  */
 
+#include <algorithm>
 #include <fstream>
 #include <iostream>
 #include <string>
+#include <utility>
 #include <vector>
-#include <unordered_map>
 
 #include "binary_file_writer.h"
+#include "byte_histogram.h"
 #include "encoder.h"
+#include "huffman_blocks.h"
+#include "huffman_stream.h"
 #include "huffman_tree.h"
 
 using namespace std;
 
+namespace
+{
+/// How many bytes of the input are held in memory at a time
+const streamsize chunk_size = 1 << 20;
+
+/**
+ * Limits a tree's codes to max_length bits, 0 meaning no limit, and
+ * reports what that costs when it changes anything.
+ */
+void limit_code_length(huffman_tree& tree, unsigned max_length, bool report)
+{
+    if (max_length == 0)
+        return;
+    uint64_t unlimited = tree.coded_bits();
+    tree.limit_code_length(max_length);
+    uint64_t limited = tree.coded_bits();
+    if (report && limited != unlimited)
+        cout << "Limiting codes to " << max_length << " bits costs "
+             << limited - unlimited << " bits (" << limited << " instead of "
+             << unlimited << ", "
+             << 100.0 * (limited - unlimited) / unlimited << "% more)"
+             << endl;
+}
+}
+
 int encoder::main(const vector<string>& args)
 {
-    if (args.size() < 4)
+    bool blocks = false;
+    bool stream = false;
+    bool interleaved = false;
+    bool canonical = false;
+    size_t block_size = huffman_blocks::default_block_size;
+    unsigned threads = 1;
+    unsigned max_length = default_max_length;
+    vector<string> names;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if (args[i] == "--blocks")
+            blocks = true;
+        else if (args[i] == "--stream")
+            stream = true;
+        else if (args[i] == "--interleaved")
+            blocks = interleaved = true;
+        else if (args[i] == "--canonical")
+            canonical = true;
+        else if (args[i] == "--block-size" && i + 1 < args.size())
+        {
+            blocks = true;
+            block_size = stoul(args[++i]);
+        }
+        else if (args[i] == "--threads" && i + 1 < args.size())
+            threads = stoul(args[++i]);
+        else if (args[i] == "--max-length" && i + 1 < args.size())
+            max_length = stoul(args[++i]);
+        else
+            names.push_back(args[i]);
+    }
+    if (names.size() != (stream ? 2 : 3) || block_size == 0
+        || max_length > 63 || (max_length > 0 && max_length < 8))
     {
         print_usage(args[0]);
         return -1;
     }
-    encode_file(args[1], args[2], args[3]);
+    if (stream && (names[0] == "-" || names[1] == "-"))
+        ios::sync_with_stdio(false);
+    if (stream)
+        encode_stream(names[0], names[1], block_size, interleaved,
+                      max_length);
+    else if (blocks)
+        encode_blocks(names[0], names[1], names[2], block_size, threads,
+                      interleaved, max_length, canonical);
+    else
+        encode_file(names[0], names[1], names[2], max_length, canonical,
+                    threads);
     return 0;
 }
 
 void encoder::print_usage(const string& programName)
 {
     cout << "Usage: " << endl;
-    cout << "\t" << programName << " input output treefile" << endl;
+    cout << "\t" << programName
+         << " [--blocks] [--interleaved] [--block-size n] [--threads n]"
+         << " [--max-length n] [--canonical] input output treefile" << endl;
+    cout << "\t" << programName
+         << " --stream [--interleaved] [--block-size n] [--max-length n]"
+         << " input output" << endl;
     cout << "\t\tinput: file to be encoded" << endl;
     cout << "\t\toutput: encoded output" << endl;
     cout << "\t\ttreefile: compressed huffman tree for decoding" << endl;
+    cout << "\t\t--blocks: write a block container, whose blocks of n bytes"
+         << endl;
+    cout << "\t\t\t(default 1MiB) can be decoded separately" << endl;
+    cout << "\t\t--threads: count the input, and code blocks, on n threads"
+         << endl;
+    cout << "\t\t\t(default 1), or 0 for one per core; each thread holds"
+         << endl;
+    cout << "\t\t\t1MiB (or a block) of the input at a time" << endl;
+    cout << "\t\t--interleaved: a block container whose blocks are split"
+         << endl;
+    cout << "\t\t\tinto four streams, for faster decoding on one core"
+         << endl;
+    cout << "\t\t--stream: write a single self-describing file with no"
+         << endl;
+    cout << "\t\t\ttreefile; input and output may be - for stdin and"
+         << endl;
+    cout << "\t\t\tstdout" << endl;
+    cout << "\t\t--max-length: no code is longer than n bits, from 8 to"
+         << endl;
+    cout << "\t\t\t63 (default " << default_max_length
+         << "), or 0 for no limit" << endl;
+    cout << "\t\t--canonical: write canonical codes and a treefile of just"
+         << endl;
+    cout << "\t\t\ttheir lengths, which decoders older than this option"
+         << endl;
+    cout << "\t\t\tcannot read" << endl;
 }
 
 void encoder::encode_file(const string& input_name, const string& output_name,
-                          const string& tree_name)
+                          const string& tree_name, unsigned max_length,
+                          bool canonical, unsigned threads)
 {
-    ifstream input(input_name);
-    stringstream ss;
-    ss << input.rdbuf();
-
-    huffman_tree tree(get_frequencies(ss.str()));
+    // two passes over the input, a chunk at a time: one to count the
+    // characters and one to encode them, so memory use does not depend
+    // on the size of the file
+    ifstream input(input_name, ios::binary);
+    huffman_tree tree(get_frequencies(input, threads));
+    limit_code_length(tree, max_length, true);
+    if (canonical)
+        tree.make_canonical();
     binary_file_writer output(output_name);
     binary_file_writer treeFile(tree_name);
 
@@ -53,17 +158,87 @@ void encoder::encode_file(const string& input_name, const string& output_name,
     tree.print(cout);
 
     cout << "Saving huffman_tree to file..." << endl;
-    tree.write(ss.str(), output);
-    tree.write_tree(treeFile);
+    input.clear();
+    input.seekg(0);
+    // a lone leaf's code is empty, and this format does not store the
+    // length of the file, so each of its characters is written as a 0 bit
+    vector<unsigned> lengths = tree.code_lengths();
+    bool lone = size_t(count(lengths.begin(), lengths.end(), 0)) + 1
+                == lengths.size();
+    vector<char> chunk(chunk_size);
+    while (input.read(chunk.data(), chunk_size) || input.gcount() > 0)
+        for (streamsize i = 0; i < input.gcount(); ++i)
+            if (lone)
+                output.write_bit(false);
+            else
+                tree.write(chunk[i], output);
+    tree.write_tree(treeFile, canonical);
+}
+
+void encoder::encode_blocks(const string& input_name,
+                            const string& output_name, const string& tree_name,
+                            size_t block_size, unsigned threads,
+                            bool interleaved, unsigned max_length,
+                            bool canonical)
+{
+    ifstream input(input_name, ios::binary);
+    huffman_tree tree(get_frequencies(input, threads));
+    limit_code_length(tree, max_length, true);
+    if (canonical)
+        tree.make_canonical();
+    binary_file_writer treeFile(tree_name);
+
+    cout << "Printing generated huffman_tree..." << endl;
+    tree.print(cout);
+
+    cout << "Saving huffman_tree to file..." << endl;
+    huffman_blocks::encode_file(input_name, output_name, tree, block_size,
+                                threads, interleaved);
+    tree.write_tree(treeFile, canonical);
+}
+
+void encoder::encode_stream(const string& input_name,
+                            const string& output_name, size_t block_size,
+                            bool interleaved, unsigned max_length)
+{
+    uint8_t flags = interleaved ? huffman_stream::flag_interleaved : 0;
+    ofstream file;
+    if (output_name != "-")
+        file.open(output_name, ios::binary);
+    ostream& output = output_name == "-" ? cout : file;
+
+    // a pipe can only be read once, so each of its blocks gets a code
+    // table of its own; a file is read twice and shares one table
+    if (input_name == "-")
+    {
+        huffman_stream::encode(cin, output, block_size, flags, max_length);
+        return;
+    }
+    ifstream input(input_name, ios::binary);
+    vector<frequency> frequencies = get_frequencies(input);
+    input.clear();
+    input.seekg(0);
+    if (frequencies.empty())
+    {
+        huffman_stream::encode(input, output, block_size, flags, max_length);
+        return;
+    }
+    huffman_tree tree(frequencies);
+    // the report would end up in the middle of the stream on stdout
+    limit_code_length(tree, max_length, output_name != "-");
+    huffman_stream::encode(input, output, move(tree), block_size, flags);
 }
 
 vector<frequency> encoder::get_frequencies(const string& str)
 {
-    unordered_map<char, int> freqs;
-    for (auto it = str.begin(); it != str.end(); ++it)
-        freqs[*it]++;
-    vector<frequency> result;
-    for (auto it = freqs.begin(); it != freqs.end(); ++it)
-        result.push_back(frequency(it->first, it->second));
-    return result;
+    byte_histogram histogram;
+    histogram.add(str.data(), str.size());
+    return histogram.frequencies();
+}
+
+vector<frequency> encoder::get_frequencies(istream& input, unsigned threads)
+{
+    byte_histogram histogram;
+    histogram.add(input, threads);
+    return histogram.frequencies();
 }
@@ -160,6 +160,18 @@ rgba_pixel const* png::operator()(size_t x, size_t y) const
     return &(pixel(x, y));
 }
 
+rgba_pixel* png::row(size_t y)
+{
+    check_xy(0, y);
+    return &(pixel(0, y));
+}
+
+rgba_pixel const* png::row(size_t y) const
+{
+    check_xy(0, y);
+    return &(pixel(0, y));
+}
+
 void png::load(const std::string& file_name)
 {
     // unfortunately, we need to break down to the C-code level here, since
@@ -0,0 +1,224 @@
+/**
+ * @file huffman_blocks.cpp
+ * Implementation of the block container format for Huffman coded files.
+ */
+
+#include <algorithm>
+#include <fstream>
+#include <future>
+#include <stdexcept>
+#include <thread>
+
+#include "binary_file_reader.h"
+#include "huffman_blocks.h"
+
+using namespace std;
+
+namespace
+{
+/// Bytes taken by the fields after the block lengths
+const streamoff trailer_size = 8 + 8 + sizeof(huffman_blocks::magic);
+
+unsigned worker_count(unsigned threads)
+{
+    return threads ? threads : max(1u, thread::hardware_concurrency());
+}
+
+void put_number(ostream& out, uint64_t value)
+{
+    char bytes[8];
+    for (int i = 0; i < 8; ++i)
+        bytes[i] = static_cast<char>(value >> (56 - 8 * i));
+    out.write(bytes, 8);
+}
+
+uint64_t get_number(istream& in)
+{
+    unsigned char bytes[8];
+    in.read(reinterpret_cast<char*>(bytes), 8);
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i)
+        value = value << 8 | bytes[i];
+    return value;
+}
+}
+
+size_t huffman_blocks::block_index::count() const
+{
+    return offsets.size() - 1;
+}
+
+size_t huffman_blocks::block_index::block_length(size_t block) const
+{
+    return min<uint64_t>(block_size, length - block * block_size);
+}
+
+bool huffman_blocks::is_container(const string& file_name)
+{
+    ifstream file(file_name, ios::binary | ios::ate);
+    streamoff size = file.tellg();
+    if (!file || size < static_cast<streamoff>(sizeof(magic)))
+        return false;
+    char last[sizeof(magic)];
+    file.seekg(size - sizeof(magic));
+    file.read(last, sizeof(magic));
+    return file && (equal(last, last + sizeof(magic), magic)
+                    || equal(last, last + sizeof(magic), interleaved_magic));
+}
+
+void huffman_blocks::encode_file(const string& input_name,
+                                 const string& output_name,
+                                 const huffman_tree& tree, size_t block_size,
+                                 unsigned threads, bool interleaved)
+{
+    if (block_size == 0)
+        throw invalid_argument("blocks must hold at least one byte");
+    ifstream input(input_name, ios::binary);
+    ofstream output(output_name, ios::binary | ios::trunc);
+
+    // each batch has a block per worker; the first is encoded on this
+    // thread and the others on their own
+    unsigned workers = worker_count(threads);
+    vector<vector<char>> batch(workers, vector<char>(block_size));
+    vector<uint64_t> lengths;
+    uint64_t total = 0;
+    bool done = false;
+    while (!done)
+    {
+        vector<size_t> sizes;
+        while (sizes.size() < workers && !done)
+        {
+            input.read(batch[sizes.size()].data(), block_size);
+            size_t size = input.gcount();
+            if (size)
+                sizes.push_back(size);
+            done = size < block_size;
+        }
+
+        auto encode = [&](size_t i)
+        {
+            vector<uint8_t> bytes;
+            if (interleaved)
+                tree.encode_interleaved(batch[i].data(), sizes[i], bytes);
+            else
+                tree.encode(batch[i].data(), sizes[i], bytes);
+            return bytes;
+        };
+        vector<future<vector<uint8_t>>> encoded;
+        for (size_t i = 1; i < sizes.size(); ++i)
+            encoded.push_back(async(launch::async, encode, i));
+        for (size_t i = 0; i < sizes.size(); ++i)
+        {
+            vector<uint8_t> bytes = i == 0 ? encode(0) : encoded[i - 1].get();
+            output.write(reinterpret_cast<const char*>(bytes.data()),
+                         bytes.size());
+            lengths.push_back(bytes.size());
+            total += sizes[i];
+        }
+    }
+
+    for (auto length : lengths)
+        put_number(output, length);
+    put_number(output, block_size);
+    put_number(output, total);
+    output.write(interleaved ? interleaved_magic : magic, sizeof(magic));
+    if (!output)
+        throw runtime_error("could not write " + output_name);
+}
+
+auto huffman_blocks::read_index(const string& file_name) -> block_index
+{
+    ifstream file(file_name, ios::binary | ios::ate);
+    streamoff size = file.tellg();
+    if (!is_container(file_name) || size < trailer_size)
+        throw runtime_error(file_name + " is not a block container");
+
+    block_index index;
+    file.seekg(size - trailer_size);
+    index.block_size = get_number(file);
+    index.length = get_number(file);
+    char last[sizeof(magic)];
+    file.read(last, sizeof(magic));
+    index.interleaved = equal(last, last + sizeof(magic), interleaved_magic);
+    if (index.block_size == 0)
+        throw runtime_error(file_name + " has a corrupt index");
+    // every block takes its length and at least its padding byte
+    uint64_t count = index.length / index.block_size
+                     + (index.length % index.block_size != 0);
+    if (count > static_cast<uint64_t>(size - trailer_size) / 9)
+        throw runtime_error(file_name + " has a corrupt index");
+
+    streamoff index_start = size - trailer_size - 8 * count;
+    file.seekg(index_start);
+    index.offsets.push_back(0);
+    for (uint64_t i = 0; i < count; ++i)
+    {
+        uint64_t length = get_number(file);
+        if (length == 0 || length > static_cast<uint64_t>(index_start))
+            throw runtime_error(file_name + " has a corrupt index");
+        index.offsets.push_back(index.offsets.back() + length);
+    }
+    if (!file || index.offsets.back() != static_cast<uint64_t>(index_start))
+        throw runtime_error(file_name + " has a corrupt index");
+    return index;
+}
+
+string huffman_blocks::decode_block(const string& file_name,
+                                    const block_index& index,
+                                    huffman_tree& tree, size_t block)
+{
+    if (block >= index.count())
+        throw out_of_range("no such block");
+    size_t expected = index.block_length(block);
+    if (index.interleaved)
+    {
+        vector<uint8_t> bytes(index.offsets[block + 1] - index.offsets[block]);
+        ifstream file(file_name, ios::binary);
+        file.seekg(index.offsets[block]);
+        file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+        if (!file)
+            throw runtime_error("could not read block " + to_string(block));
+        string out(expected, '\0');
+        tree.decode_interleaved(bytes.data(), bytes.size(), &out[0], expected);
+        return out;
+    }
+
+    binary_file_reader bfile(file_name, index.offsets[block],
+                             index.offsets[block + 1] - index.offsets[block]);
+    string out = tree.decode_file(bfile);
+    // a tree with a single character codes it with no bits at all
+    if (out.empty() && expected)
+        out.assign(expected, tree.decode_char(bfile));
+    if (out.size() != expected)
+        throw runtime_error("block " + to_string(block) + " is corrupt");
+    return out;
+}
+
+void huffman_blocks::decode_file(const string& file_name,
+                                 const huffman_tree& tree, ostream& out,
+                                 unsigned threads)
+{
+    block_index index = read_index(file_name);
+
+    // each worker has its own copy of the tree, and so its own decoding
+    // table; the first block of each batch is decoded on this thread
+    unsigned workers = worker_count(threads);
+    vector<huffman_tree> trees(min<size_t>(workers, index.count()), tree);
+    for (size_t first = 0; first < index.count(); first += trees.size())
+    {
+        size_t count = min(trees.size(), index.count() - first);
+        vector<future<string>> parts;
+        for (size_t i = 1; i < count; ++i)
+            parts.push_back(async(launch::async, [&, i]
+            {
+                return decode_block(file_name, index, trees[i], first + i);
+            }));
+        string part = decode_block(file_name, index, trees[0], first);
+        out.write(part.data(), part.size());
+        for (auto& next : parts)
+        {
+            part = next.get();
+            out.write(part.data(), part.size());
+        }
+    }
+}
@@ -0,0 +1,437 @@
+/**
+ * @file huffman_buffer.cpp
+ * Implementation of Huffman coding buffers in memory.
+ */
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <stdexcept>
+
+#include "byte_histogram.h"
+#include "huffman_buffer.h"
+
+using namespace std;
+using namespace huffman_buffer;
+
+namespace
+{
+/**
+ * The codes for one buffer.
+ */
+struct code_table
+{
+    /// Length of each character's code, 0 for none
+    array<uint8_t, 256> lengths;
+    /// Each character's code, in its low lengths bits
+    array<uint16_t, 256> codes;
+    /// How many characters have a code
+    unsigned count;
+};
+
+/// The number of entries in a decode table
+const size_t table_size = size_t(1) << max_code_length;
+
+void put_number(uint8_t* out, uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i)
+        *out++ = static_cast<uint8_t>(value >> (8 * i));
+}
+
+uint64_t get_number(const uint8_t* in, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+        value = value << 8 | in[i];
+    return value;
+}
+
+/**
+ * Gives each character with a code its canonical code, from the lengths.
+ */
+void assign_codes(code_table& table)
+{
+    array<unsigned, max_code_length + 1> per_length{};
+    for (auto length : table.lengths)
+        ++per_length[length];
+    per_length[0] = 0;
+
+    // the first code of each length follows the last code one bit shorter,
+    // as in huffman_tree::build_canonical
+    array<unsigned, max_code_length + 1> next{};
+    unsigned code = 0;
+    for (unsigned length = 1; length <= max_code_length; ++length)
+    {
+        code = (code + per_length[length - 1]) << 1;
+        next[length] = code;
+    }
+    for (size_t c = 0; c < table.lengths.size(); ++c)
+        if (table.lengths[c])
+            table.codes[c] = next[table.lengths[c]]++;
+}
+
+/**
+ * Finds codes of at most max_code_length bits for the characters counted.
+ * The optimal lengths are found in place (Moffat and Katajainen's method
+ * on the sorted counts); any that are too long are cut to
+ * max_code_length, and then the longest codes that fit are lengthened
+ * until the code is complete again.
+ */
+void build_table(const array<uint64_t, 256>& counts, code_table& table)
+{
+    // the characters with a count, rarest first
+    array<uint8_t, 256> order;
+    unsigned n = 0;
+    for (size_t c = 0; c < counts.size(); ++c)
+        if (counts[c])
+            order[n++] = static_cast<uint8_t>(c);
+    sort(order.begin(), order.begin() + n, [&](uint8_t a, uint8_t b)
+    {
+        return counts[a] != counts[b] ? counts[a] < counts[b] : a < b;
+    });
+
+    table.lengths.fill(0);
+    table.count = n;
+    if (n == 0)
+        return;
+    if (n == 1)
+    {
+        // a lone character's empty code is stored as length 1
+        table.lengths[order[0]] = 1;
+        assign_codes(table);
+        return;
+    }
+
+    // weights first becomes the tree's internal nodes, each pointing to
+    // its parent, then their depths, then the leaves' depths
+    array<uint64_t, 256> weights;
+    for (unsigned i = 0; i < n; ++i)
+        weights[i] = counts[order[i]];
+    weights[0] += weights[1];
+    unsigned root = 0;
+    unsigned leaf = 2;
+    for (unsigned next = 1; next < n - 1; ++next)
+    {
+        if (leaf >= n || weights[root] < weights[leaf])
+        {
+            weights[next] = weights[root];
+            weights[root++] = next;
+        }
+        else
+            weights[next] = weights[leaf++];
+        if (leaf >= n || (root < next && weights[root] < weights[leaf]))
+        {
+            weights[next] += weights[root];
+            weights[root++] = next;
+        }
+        else
+            weights[next] += weights[leaf++];
+    }
+    weights[n - 2] = 0;
+    for (unsigned next = n - 2; next-- > 0;)
+        weights[next] = weights[weights[next]] + 1;
+
+    // how many leaves there are at each depth
+    array<unsigned, 256> per_length{};
+    unsigned available = 1;
+    unsigned used = 0;
+    unsigned depth = 0;
+    int internal = n - 2;
+    while (available > 0)
+    {
+        while (internal >= 0 && weights[internal] == depth)
+        {
+            ++used;
+            --internal;
+        }
+        per_length[depth] = available - used;
+        available = 2 * used;
+        ++depth;
+        used = 0;
+    }
+
+    // cut the codes that are too long, then make room for them by
+    // lengthening the longest codes that are shorter
+    for (size_t length = max_code_length + 1; length < per_length.size();
+         ++length)
+    {
+        per_length[max_code_length] += per_length[length];
+        per_length[length] = 0;
+    }
+    uint64_t total = 0;
+    for (unsigned length = 1; length <= max_code_length; ++length)
+        total += uint64_t(per_length[length]) << (max_code_length - length);
+    while (total > table_size)
+    {
+        --per_length[max_code_length];
+        for (unsigned length = max_code_length - 1; length > 0; --length)
+            if (per_length[length])
+            {
+                --per_length[length];
+                per_length[length + 1] += 2;
+                break;
+            }
+        --total;
+    }
+
+    // the rarest characters get the longest codes
+    unsigned i = 0;
+    for (unsigned length = max_code_length; length > 0; --length)
+        for (unsigned k = 0; k < per_length[length]; ++k)
+            table.lengths[order[i++]] = length;
+    assign_codes(table);
+}
+
+/**
+ * Works out how to code some data.
+ *
+ * @param table Set to the codes, with count 0 if the data is to be stored.
+ * @return The size of the coded buffer.
+ */
+size_t plan(const char* data, size_t size, code_table& table)
+{
+    byte_histogram histogram;
+    histogram.add(data, size);
+    const auto& counts = histogram.counts();
+    build_table(counts, table);
+    if (table.count == 0)
+        return header_size;
+
+    uint64_t bits = 0;
+    if (table.count > 1)
+        for (size_t c = 0; c < counts.size(); ++c)
+            bits += counts[c] * table.lengths[c];
+    uint64_t coded = header_size + 1 + 2 * table.count + (bits + 7) / 8;
+    if (coded >= header_size + size)
+    {
+        table.count = 0;
+        return header_size + size;
+    }
+    return coded;
+}
+
+/**
+ * Writes the coded buffer plan worked out, into out, which must be large
+ * enough.
+ */
+void write(const char* data, size_t size, const code_table& table,
+           uint8_t* out)
+{
+    memcpy(out, magic, sizeof(magic));
+    out[sizeof(magic)] = table.count ? mode_coded : mode_stored;
+    put_number(out + sizeof(magic) + 1, size, 8);
+    out += header_size;
+    if (table.count == 0)
+    {
+        if (size)
+            memcpy(out, data, size);
+        return;
+    }
+
+    *out++ = static_cast<uint8_t>(table.count - 1);
+    for (size_t c = 0; c < table.lengths.size(); ++c)
+        if (table.lengths[c])
+        {
+            *out++ = static_cast<uint8_t>(c);
+            *out++ = table.lengths[c];
+        }
+    // a lone character has an empty code
+    if (table.count == 1)
+        return;
+
+    // codes are gathered in window and written out four bytes at a time
+    uint64_t window = 0;
+    unsigned bits = 0;
+    for (size_t i = 0; i < size; ++i)
+    {
+        uint8_t c = static_cast<uint8_t>(data[i]);
+        window = window << table.lengths[c] | table.codes[c];
+        bits += table.lengths[c];
+        if (bits >= 32)
+        {
+            bits -= 32;
+            put_number(out, window >> bits, 4);
+            out += 4;
+        }
+    }
+    for (; bits >= 8; bits -= 8)
+        *out++ = static_cast<uint8_t>(window >> (bits - 8));
+    if (bits)
+        *out++ = static_cast<uint8_t>(window << (8 - bits));
+}
+
+/**
+ * Reads a code table, checking that it is a complete code no longer than
+ * max_code_length.
+ *
+ * @return Where the codes start.
+ */
+size_t read_table(const uint8_t* data, size_t size, code_table& table)
+{
+    size_t at = header_size;
+    if (at >= size)
+        throw runtime_error("huffman buffer is truncated");
+    table.count = data[at++] + 1u;
+    if (size - at < 2 * table.count)
+        throw runtime_error("huffman buffer is truncated");
+
+    table.lengths.fill(0);
+    uint64_t total = 0;
+    int last = -1;
+    for (unsigned i = 0; i < table.count; ++i)
+    {
+        int c = data[at++];
+        unsigned length = data[at++];
+        if (c <= last || length == 0 || length > max_code_length)
+            throw runtime_error("huffman buffer has a bad code table");
+        last = c;
+        table.lengths[c] = length;
+        total += table_size >> length;
+    }
+    if (table.count > 1 ? total != table_size : table.lengths[last] != 1)
+        throw runtime_error("huffman buffer has a bad code table");
+    assign_codes(table);
+    return at;
+}
+
+/**
+ * Checks that a coded buffer holds as much as its header says it decodes
+ * to, before anything is written or allocated for it.
+ *
+ * @param length The decoded length from the header.
+ * @param table Set to the codes, with count 0 if the data is stored.
+ * @return Where the codes (or the stored data) start.
+ */
+size_t check(const uint8_t* data, size_t size, uint64_t length,
+             code_table& table)
+{
+    if (data[sizeof(magic)] == mode_stored)
+    {
+        if (size - header_size != length)
+            throw runtime_error("huffman buffer is corrupt");
+        table.count = 0;
+        return header_size;
+    }
+    size_t at = read_table(data, size, table);
+    // a lone character has no code bits, and every other code is at least
+    // a bit long
+    if (table.count == 1 ? at != size : length > 8 * uint64_t(size - at))
+        throw runtime_error("huffman buffer is corrupt");
+    return at;
+}
+
+/**
+ * Decodes a buffer check has passed into out, which has room for length
+ * bytes.
+ */
+size_t decode_codes(const uint8_t* data, size_t size, uint64_t length,
+                    const code_table& table, size_t at, char* out)
+{
+    if (table.count == 0)
+    {
+        if (length)
+            memcpy(out, data + at, length);
+        return length;
+    }
+    if (table.count == 1)
+    {
+        auto c = find(table.lengths.begin(), table.lengths.end(), 1);
+        memset(out, static_cast<char>(c - table.lengths.begin()), length);
+        return length;
+    }
+
+    // each entry holds the character whose code starts with its index,
+    // and that code's length above it
+    array<uint16_t, table_size> entries;
+    for (size_t c = 0; c < table.lengths.size(); ++c)
+        if (unsigned code_length = table.lengths[c])
+        {
+            unsigned spare = max_code_length - code_length;
+            fill_n(entries.begin() + (size_t(table.codes[c]) << spare),
+                   size_t(1) << spare,
+                   static_cast<uint16_t>(c | code_length << 8));
+        }
+
+    // the window holds the next bits at its top; past the end of the
+    // buffer it is filled with zeros, which is checked for once everything
+    // is decoded
+    const size_t start = at;
+    const unsigned per_refill = 57 / max_code_length;
+    uint64_t window = 0;
+    unsigned bits = 0;
+    for (uint64_t i = 0; i < length;)
+    {
+        // a refill leaves room for per_refill codes, whatever they are
+        for (; bits <= 56; bits += 8, ++at)
+            window |= uint64_t(at < size ? data[at] : 0) << (56 - bits);
+        uint64_t last = min<uint64_t>(i + per_refill, length);
+        for (; i < last; ++i)
+        {
+            uint16_t entry = entries[window >> (64 - max_code_length)];
+            out[i] = static_cast<char>(entry);
+            window <<= entry >> 8;
+            bits -= entry >> 8;
+        }
+    }
+    uint64_t used = 8 * uint64_t(at - start) - bits;
+    if ((used + 7) / 8 != size - start)
+        throw runtime_error("huffman buffer is corrupt");
+    return length;
+}
+}
+
+size_t huffman_buffer::max_encoded_size(size_t size)
+{
+    return header_size + size;
+}
+
+size_t huffman_buffer::encode(const char* data, size_t size, uint8_t* out,
+                              size_t capacity)
+{
+    code_table table;
+    size_t coded = plan(data, size, table);
+    if (coded > capacity)
+        throw length_error("huffman buffer does not fit");
+    write(data, size, table, out);
+    return coded;
+}
+
+void huffman_buffer::encode(const char* data, size_t size,
+                            vector<uint8_t>& out)
+{
+    code_table table;
+    out.resize(plan(data, size, table));
+    write(data, size, table, out.data());
+}
+
+uint64_t huffman_buffer::decoded_size(const uint8_t* data, size_t size)
+{
+    if (size < header_size || !equal(magic, magic + sizeof(magic), data))
+        throw runtime_error("not a huffman buffer");
+    if (data[sizeof(magic)] > mode_coded)
+        throw runtime_error("unsupported huffman buffer mode");
+    return get_number(data + sizeof(magic) + 1, 8);
+}
+
+size_t huffman_buffer::decode(const uint8_t* data, size_t size, char* out,
+                              size_t capacity)
+{
+    uint64_t length = decoded_size(data, size);
+    code_table table;
+    size_t at = check(data, size, length, table);
+    if (length > capacity)
+        throw length_error("huffman buffer does not fit");
+    return decode_codes(data, size, length, table, at, out);
+}
+
+void huffman_buffer::decode(const uint8_t* data, size_t size, string& out,
+                            uint64_t max_size)
+{
+    uint64_t length = decoded_size(data, size);
+    code_table table;
+    size_t at = check(data, size, length, table);
+    if (length > max_size)
+        throw length_error("huffman buffer is larger than allowed");
+    out.resize(length);
+    decode_codes(data, size, length, table, at, &out[0]);
+}
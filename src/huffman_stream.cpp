@@ -0,0 +1,220 @@
+/**
+ * @file huffman_stream.cpp
+ * Implementation of the single file Huffman stream format.
+ */
+
+#include <algorithm>
+#include <array>
+#include <memory>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "byte_histogram.h"
+#include "huffman_stream.h"
+
+using namespace std;
+
+namespace
+{
+/// The largest block a stream may hold, so a damaged length cannot make
+/// the decoder allocate without bound
+const uint64_t max_block_size = uint64_t(1) << 30;
+
+void put_number(ostream& out, uint64_t value, int bytes)
+{
+    for (int i = bytes - 1; i >= 0; --i)
+        out.put(static_cast<char>(value >> (8 * i)));
+}
+
+uint64_t get_number(istream& in, int bytes)
+{
+    uint64_t value = 0;
+    for (int i = 0; i < bytes; ++i)
+    {
+        int byte = in.get();
+        if (byte == istream::traits_type::eof())
+            throw runtime_error("huffman stream is truncated");
+        value = value << 8 | static_cast<uint8_t>(byte);
+    }
+    return value;
+}
+
+void write_table(ostream& out, const huffman_tree& tree)
+{
+    vector<unsigned> lengths = tree.code_lengths();
+    size_t count = lengths.size() - std::count(lengths.begin(), lengths.end(), 0);
+    out.put(huffman_stream::frame_table);
+    put_number(out, count - 1, 1);
+    for (size_t c = 0; c < lengths.size(); ++c)
+        if (lengths[c])
+        {
+            put_number(out, c, 1);
+            put_number(out, lengths[c], 1);
+        }
+}
+
+/**
+ * Writes a whole stream. Blocks are coded with tree when it is given, and
+ * otherwise each with a canonical tree of its own, whose codes are at most
+ * max_length bits unless it is 0.
+ */
+void encode_blocks(istream& in, ostream& out, const huffman_tree* tree,
+                   size_t block_size, uint8_t flags, unsigned max_length)
+{
+    if (block_size == 0 || block_size > max_block_size)
+        throw invalid_argument("block size must be between 1 byte and 1 GiB");
+    if (flags & ~huffman_stream::flag_interleaved)
+        throw invalid_argument("unknown huffman stream flags");
+
+    out.write(huffman_stream::magic, sizeof(huffman_stream::magic));
+    out.put(huffman_stream::version);
+    out.put(flags);
+    if (tree)
+        write_table(out, *tree);
+
+    vector<char> block(block_size);
+    vector<uint8_t> bytes;
+    uint64_t total = 0;
+    uint32_t crc = 0;
+    while (in.read(block.data(), block_size) || in.gcount() > 0)
+    {
+        size_t size = in.gcount();
+        total += size;
+        crc = huffman_stream::crc32(block.data(), size, crc);
+
+        unique_ptr<huffman_tree> own;
+        const huffman_tree* coder = tree;
+        if (!coder)
+        {
+            byte_histogram histogram;
+            histogram.add(block.data(), size);
+            own.reset(new huffman_tree(histogram.frequencies()));
+            if (max_length)
+                own->limit_code_length(max_length);
+            own->make_canonical();
+            write_table(out, *own);
+            coder = own.get();
+        }
+
+        bytes.clear();
+        if (flags & huffman_stream::flag_interleaved)
+            coder->encode_interleaved(block.data(), size, bytes);
+        else
+            coder->encode(block.data(), size, bytes);
+        out.put(huffman_stream::frame_block);
+        put_number(out, size, 8);
+        put_number(out, bytes.size(), 8);
+        out.write(reinterpret_cast<const char*>(bytes.data()), bytes.size());
+    }
+
+    out.put(huffman_stream::frame_end);
+    put_number(out, total, 8);
+    put_number(out, crc, 4);
+    out.flush();
+    if (!out)
+        throw runtime_error("could not write the huffman stream");
+}
+}
+
+uint32_t huffman_stream::crc32(const char* data, size_t size, uint32_t crc)
+{
+    static const array<uint32_t, 256> table = []
+    {
+        array<uint32_t, 256> entries;
+        for (uint32_t n = 0; n < entries.size(); ++n)
+        {
+            uint32_t c = n;
+            for (int k = 0; k < 8; ++k)
+                c = c & 1 ? 0xedb88320u ^ (c >> 1) : c >> 1;
+            entries[n] = c;
+        }
+        return entries;
+    }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+        crc = table[(crc ^ static_cast<uint8_t>(data[i])) & 0xff] ^ (crc >> 8);
+    return ~crc;
+}
+
+void huffman_stream::encode(istream& in, ostream& out, size_t block_size,
+                            uint8_t flags, unsigned max_length)
+{
+    encode_blocks(in, out, nullptr, block_size, flags, max_length);
+}
+
+void huffman_stream::encode(istream& in, ostream& out, huffman_tree tree,
+                            size_t block_size, uint8_t flags)
+{
+    tree.make_canonical();
+    encode_blocks(in, out, &tree, block_size, flags, 0);
+}
+
+void huffman_stream::decode(istream& in, ostream& out)
+{
+    char header[sizeof(magic) + 2];
+    in.read(header, sizeof(header));
+    if (!in || !equal(magic, magic + sizeof(magic), header))
+        throw runtime_error("not a huffman stream");
+    if (static_cast<uint8_t>(header[4]) != version)
+        throw runtime_error("unsupported huffman stream version");
+    uint8_t flags = header[5];
+    if (flags & ~flag_interleaved)
+        throw runtime_error("unsupported huffman stream flags");
+
+    unique_ptr<huffman_tree> tree;
+    vector<uint8_t> bytes;
+    string block;
+    uint64_t total = 0;
+    uint32_t crc = 0;
+    while (true)
+    {
+        uint64_t kind = get_number(in, 1);
+        if (kind == frame_table)
+        {
+            vector<unsigned> lengths(256, 0);
+            unsigned count = get_number(in, 1) + 1;
+            for (unsigned i = 0; i < count; ++i)
+            {
+                uint64_t c = get_number(in, 1);
+                lengths[c] = get_number(in, 1);
+            }
+            tree.reset(new huffman_tree(lengths));
+        }
+        else if (kind == frame_block)
+        {
+            if (!tree)
+                throw runtime_error("huffman stream has a block before its table");
+            uint64_t size = get_number(in, 8);
+            uint64_t coded = get_number(in, 8);
+            // no canonical code is longer than 63 bits
+            if (size > max_block_size || coded > (63 * size + 7) / 8 + 64)
+                throw runtime_error("huffman stream is corrupt");
+            bytes.resize(coded);
+            in.read(reinterpret_cast<char*>(bytes.data()), coded);
+            if (static_cast<uint64_t>(in.gcount()) != coded)
+                throw runtime_error("huffman stream is truncated");
+
+            block.resize(size);
+            if (flags & flag_interleaved)
+                tree->decode_interleaved(bytes.data(), coded, &block[0], size);
+            else
+                tree->decode(bytes.data(), coded, &block[0], size);
+            total += size;
+            crc = crc32(block.data(), size, crc);
+            out.write(block.data(), size);
+        }
+        else if (kind == frame_end)
+        {
+            uint64_t length = get_number(in, 8);
+            uint64_t expected = get_number(in, 4);
+            if (length != total || expected != crc)
+                throw runtime_error("huffman stream does not match its checksum");
+            out.flush();
+            return;
+        }
+        else
+            throw runtime_error("huffman stream is corrupt");
+    }
+}
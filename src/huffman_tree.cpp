@@ -8,6 +8,7 @@
 
 #include <algorithm>
 #include <iostream>
+#include <iterator>
 #include <queue>
 #include <utility>
 #include <stdexcept>
@@ -16,6 +17,33 @@
 
 using namespace std;
 
+namespace
+{
+/**
+ * Reads an n bit number, high bit first, checking that the bits are there.
+ */
+unsigned read_bits(binary_file_reader& bfile, unsigned n)
+{
+    unsigned value = 0;
+    for (unsigned i = 0; i < n; ++i)
+    {
+        if (!bfile.has_bits())
+            throw runtime_error("file ended in the middle of a huffman_tree");
+        value = value << 1 | bfile.next_bit();
+    }
+    return value;
+}
+
+/**
+ * Writes the low n bits of value, high bit first.
+ */
+void write_bits(binary_file_writer& bfile, unsigned value, unsigned n)
+{
+    while (n-- > 0)
+        bfile.write_bit((value >> n) & 1);
+}
+}
+
 huffman_tree::huffman_tree(vector<frequency> frequencies)
 {
     std::stable_sort(frequencies.begin(), frequencies.end());
@@ -24,6 +52,13 @@ huffman_tree::huffman_tree(vector<frequency> frequencies)
     build_map(root_.get(), path);
 }
 
+huffman_tree::huffman_tree(const vector<unsigned>& lengths)
+{
+    build_canonical(lengths, vector<int>(lengths.size(), 0));
+    vector<bool> path;
+    build_map(root_.get(), path);
+}
+
 huffman_tree::huffman_tree(const huffman_tree& other)
 {
     copy(other);
@@ -31,7 +66,25 @@ huffman_tree::huffman_tree(const huffman_tree& other)
 
 huffman_tree::huffman_tree(binary_file_reader& bfile)
 {
-    root_ = read_tree(bfile);
+    if (read_bits(bfile, 1) == 0)
+    {
+        // a preorder tree with an internal root
+        root_ = std::make_unique<node>(0);
+        root_->left = read_tree(bfile);
+        root_->right = read_tree(bfile);
+    }
+    else
+    {
+        // either a preorder tree that is a lone leaf, which ends after its
+        // character, or a canonical tree's character count
+        unsigned value = read_bits(bfile, 8);
+        if (!bfile.has_bits())
+            root_ = std::make_unique<node>(
+                frequency(static_cast<char>(value), 0));
+        else
+            build_canonical(read_lengths(bfile, value + 1),
+                            vector<int>(256, 0));
+    }
     vector<bool> path;
     build_map(root_.get(), path);
 }
@@ -46,11 +99,17 @@ void huffman_tree::swap(huffman_tree& other)
 {
     std::swap(root_, other.root_);
     std::swap(bits_map_, other.bits_map_);
+    std::swap(codes_, other.codes_);
+    std::swap(table_, other.table_);
+    std::swap(canonical_, other.canonical_);
 }
 
 void huffman_tree::copy(const huffman_tree& rhs)
 {
     root_ = copy(rhs.root_.get());
+    bits_map_ = rhs.bits_map_;
+    codes_ = rhs.codes_;
+    canonical_ = rhs.canonical_;
 }
 
 auto huffman_tree::copy(const node* current) -> std::unique_ptr<node>
@@ -88,6 +147,13 @@ void huffman_tree::build_tree(const vector<frequency>& frequencies)
      * to the root and you're done!
      */
 
+	if (frequencies.empty()) throw runtime_error("huffman_tree has no characters");
+	//a single character is a lone leaf, with an empty code
+	if (frequencies.size() == 1){
+		root_ = std::unique_ptr<node>(new node(frequencies[0]));
+		return;
+	}
+
 	//build single_queue
 	for (auto p : frequencies) single_queue.push(std::unique_ptr<node>(new node(p)));	
 	
@@ -110,6 +176,12 @@ void huffman_tree::build_map(const node* current, vector<bool>& path)
     if (!current->left && !current->right)
     {
         bits_map_[current->freq.character()] = path;
+        packed_code& code = codes_[static_cast<uint8_t>(
+            current->freq.character())];
+        code.bits = 0;
+        code.length = path.size();
+        for (size_t i = 0; i < path.size() && i < 64; ++i)
+            code.bits = code.bits << 1 | path[i];
         return;
     }
 
@@ -173,59 +245,222 @@ auto huffman_tree::remove_smallest(
 
 string huffman_tree::decode_file(binary_file_reader& bfile)
 {
-    stringstream ss;
-    decode(ss, bfile);
-    return ss.str();
-}
-
-void huffman_tree::decode(stringstream& ss, binary_file_reader& bfile)
-{
-    auto current = root_.get();
-    bool hasBeenLooped = false;
-    while (bfile.has_bits())
-    {
-      /**
-       * @todo Your code here!
-       *
-       * This code is reading in all of the bits in the binary file
-       * given. After reading a bit, we go left if the bit was a 0 (or
-       * false), and we go right if the bit was a 1 (or true).
-       *
-       * Special case: if we are at a leaf node, we should "print" its
-       * character to the stringstream (with operator<<, just like cout)
-       * and start traversing from the root node again.
-       */
-	hasBeenLooped = true;
-		 if (current->left&&current->right) {
-			auto direction = bfile.next_bit();
-			//std:cout<<direction<<std::endl;
-			if (!direction){ // ==0
-				current = current->left.get();
-			}
-			else if(direction){// ==1
-				current = current->right.get();
-			}
-			else throw logic_error("err in inner logic of decode");
-		}
-		else if (!(current->left||current->right)){//actually, if no 1 child, then no child.... 
-			//std::cout<<"print: "<<current->freq.character()<<std::endl;
+    string out;
+    decode(bfile, [&](const char* data, size_t size)
+    {
+        out.append(data, size);
+    });
+    return out;
+}
 
-			ss<<(current->freq.character());
-			current = root_.get();
-		}
-		else throw std::logic_error("error in if logic in decode()");
+void huffman_tree::decode_file(binary_file_reader& bfile, std::ostream& out)
+{
+    decode(bfile, [&](const char* data, size_t size)
+    {
+        out.write(data, size);
+    });
+}
+
+void huffman_tree::decode(binary_file_reader& bfile,
+                          const std::function<void(const char*, size_t)>& flush)
+{
+    // a lone leaf has an empty code, so there is nothing to read
+    if (!root_->left)
+        return;
+
+    // the input is read a block at a time into data; once the last block
+    // is in, the trailing bits are put in a byte of their own, followed
+    // by 8 zero bytes so the window below can be filled past the end
+    const std::streamoff bits = bfile.bits_left();
+    std::streamoff whole_bytes = bits / 8;
+    vector<uint8_t> data(block_size_ + 24);
+    const uint8_t* next = data.data();
+    const uint8_t* end = next;
+    auto load = [&]
+    {
+        size_t kept = end - next;
+        std::copy(next, end, data.begin());
+        size_t count = std::min<std::streamoff>(block_size_, whole_bytes);
+        bfile.read_bytes(data.data() + kept, count);
+        whole_bytes -= count;
+        size_t size = kept + count;
+        if (!whole_bytes && bfile.has_bits())
+        {
+            uint8_t last = 0;
+            for (int bit = 7; bfile.has_bits(); --bit)
+                last |= bfile.next_bit() << bit;
+            data[size++] = last;
+        }
+        std::fill(data.begin() + size, data.begin() + size + 8, 0);
+        next = data.data();
+        end = next + size;
+    };
+
+    // decoded characters go into a buffer of the same size, which is
+    // handed to flush whenever it fills up
+    vector<char> buffer(block_size_);
+    char* put = buffer.data();
+    char* const buffer_end = put + buffer.size();
+    auto emit = [&](char c)
+    {
+        *put++ = c;
+        if (put == buffer_end)
+        {
+            flush(buffer.data(), buffer.size());
+            put = buffer.data();
+        }
+    };
+
+    // the next bits of the input are kept at the top of window, which is
+    // topped up a byte at a time so it always has room for a table index
+    if (table_.empty())
+        table_ = build_table();
+    const vector<decode_entry>& table = table_;
+    uint64_t window = 0;
+    unsigned in_window = 0;
+    auto refill = [&]
+    {
+        if (end - next < 8 && whole_bytes)
+            load();
+        while (in_window <= 56)
+        {
+            window |= uint64_t(*next++) << (56 - in_window);
+            in_window += 8;
+        }
+    };
+    // walks the rest of a code longer than the table index
+    auto finish_long_code = [&](const node* current, std::streamoff& pos)
+    {
+        while (current->left)
+        {
+            if (pos >= bits)
+                throw runtime_error("file ended in the middle of a code");
+            refill();
+            current = window >> 63 ? current->right.get()
+                                   : current->left.get();
+            window <<= 1;
+            --in_window;
+            ++pos;
+        }
+        emit(current->freq.character());
+    };
+
+    // a full window holds five table-sized codes, so away from the end
+    // they can be taken without checking for it, as long as the buffer
+    // has room for them
+    const unsigned per_refill = 57 / table_bits_;
+    load();
+    std::streamoff pos = 0;
+    while (bits - pos >= 64)
+    {
+        refill();
+        if (buffer_end - put <= per_refill)
+        {
+            flush(buffer.data(), put - buffer.data());
+            put = buffer.data();
+        }
+        for (unsigned i = 0; i < per_refill; ++i)
+        {
+            const decode_entry& entry = table[window >> (64 - table_bits_)];
+            if (!entry.length)
+            {
+                window <<= table_bits_;
+                in_window -= table_bits_;
+                pos += table_bits_;
+                finish_long_code(entry.next, pos);
+                break;
+            }
+            *put++ = entry.symbol;
+            window <<= entry.length;
+            in_window -= entry.length;
+            pos += entry.length;
+        }
     }
-	if (hasBeenLooped){
-		 if (current->left&&current->right) {
-			throw logic_error("err in inner logic of decode");
-		}
 
-		else if (!(current->left||current->right)){
+    while (pos < bits)
+    {
+        refill();
+        const decode_entry& entry = table[window >> (64 - table_bits_)];
+        if (!entry.length)
+        {
+            window <<= table_bits_;
+            in_window -= table_bits_;
+            pos += table_bits_;
+            finish_long_code(entry.next, pos);
+            continue;
+        }
+        if (entry.length > bits - pos)
+            throw runtime_error("file ended in the middle of a code");
+        emit(entry.symbol);
+        window <<= entry.length;
+        in_window -= entry.length;
+        pos += entry.length;
+    }
+    if (put != buffer.data())
+        flush(buffer.data(), put - buffer.data());
+}
 
-			ss<<(current->freq.character());
-			current = root_.get();
-		}
-	}
+auto huffman_tree::build_table() const -> vector<decode_entry>
+{
+    vector<decode_entry> table(size_t(1) << table_bits_);
+    fill_table(root_.get(), 0, 0, table);
+    return table;
+}
+
+void huffman_tree::fill_table(const node* current, uint32_t code,
+                              unsigned length,
+                              vector<decode_entry>& table) const
+{
+    if (!current->left)
+    {
+        // every index that starts with this code
+        unsigned free_bits = table_bits_ - length;
+        for (uint32_t i = 0; i < (uint32_t(1) << free_bits); ++i)
+            table[code << free_bits | i] = {current, current->freq.character(),
+                                            static_cast<uint8_t>(length)};
+        return;
+    }
+    if (length == table_bits_)
+    {
+        table[code] = {current, '\0', 0};
+        return;
+    }
+    fill_table(current->left.get(), code << 1, length + 1, table);
+    fill_table(current->right.get(), code << 1 | 1, length + 1, table);
+}
+
+char huffman_tree::decode_char(binary_file_reader& bfile)
+{
+    // a lone leaf has an empty code
+    if (!root_->left)
+        return root_->freq.character();
+    if (table_.empty())
+        table_ = build_table();
+
+    const decode_entry& entry = table_[bfile.peek_bits(table_bits_)];
+    if (entry.length)
+    {
+        if (entry.length > bfile.bits_left())
+            throw runtime_error("file ended in the middle of a code");
+        bfile.consume(entry.length);
+        return entry.symbol;
+    }
+
+    // a long code: walk the rest of it one bit at a time
+    if (bfile.bits_left() < table_bits_)
+        throw runtime_error("file ended in the middle of a code");
+    bfile.consume(table_bits_);
+    auto current = entry.next;
+    while (current->left)
+    {
+        if (!bfile.has_bits())
+            throw runtime_error("file ended in the middle of a code");
+        if (bfile.next_bit())
+            current = current->right.get();
+        else
+            current = current->left.get();
+    }
+    return current->freq.character();
 }
 
 void huffman_tree::write(const string& data, binary_file_writer& bfile)
@@ -236,19 +471,541 @@ void huffman_tree::write(const string& data, binary_file_writer& bfile)
 
 void huffman_tree::write(char c, binary_file_writer& bfile)
 {
+    const packed_code& code = codes_[static_cast<uint8_t>(c)];
+    if (code.length <= 64)
+    {
+        bfile.write_bits(code.bits, code.length);
+        return;
+    }
     vector<bool> bits = bits_for_char(c);
     for (const auto& b : bits)
         bfile.write_bit(b);
 }
 
+void huffman_tree::encode(const char* data, size_t size,
+                          vector<uint8_t>& out) const
+{
+    encode_strided(data, size, 1, out);
+}
+
+void huffman_tree::encode_strided(const char* data, size_t size,
+                                  size_t stride, vector<uint8_t>& out) const
+{
+    // bits are gathered at the bottom of word, and whole bytes taken from
+    // the top of them
+    uint64_t word = 0;
+    unsigned word_bits = 0;
+    auto put = [&](uint64_t bits, unsigned length)
+    {
+        word = word << length | bits;
+        word_bits += length;
+        while (word_bits >= 8)
+        {
+            word_bits -= 8;
+            out.push_back(static_cast<uint8_t>(word >> word_bits));
+        }
+    };
+    for (size_t i = 0; i < size; i += stride)
+    {
+        const packed_code& code = codes_[static_cast<uint8_t>(data[i])];
+        if (code.length <= 56)
+        {
+            put(code.bits, code.length);
+            continue;
+        }
+        for (bool bit : bits_map_.at(data[i]))
+            put(bit, 1);
+    }
+    unsigned padding = (8 - word_bits) % 8;
+    if (word_bits)
+        put(0, padding);
+    out.push_back(static_cast<uint8_t>(padding));
+}
+
+void huffman_tree::encode_interleaved(const char* data, size_t size,
+                                      vector<uint8_t>& out) const
+{
+    size_t header = out.size();
+    out.resize(header + 8 * (interleaved_streams - 1));
+    for (unsigned k = 0; k < interleaved_streams; ++k)
+    {
+        size_t first = std::min<size_t>(k, size);
+        size_t start = out.size();
+        encode_strided(data + first, size - first, interleaved_streams, out);
+        if (k + 1 == interleaved_streams)
+            break;
+        uint64_t length = out.size() - start;
+        for (int i = 0; i < 8; ++i)
+            out[header + 8 * k + i] = static_cast<uint8_t>(length >> (56 - 8 * i));
+    }
+}
+
+void huffman_tree::decode(const uint8_t* data, size_t size, char* out,
+                          size_t count)
+{
+    size_t bounds[2] = {0, size};
+    decode_streams<1>(data, bounds, out, count);
+}
+
+void huffman_tree::decode_interleaved(const uint8_t* data, size_t size,
+                                      char* out, size_t count)
+{
+    const size_t header = 8 * (interleaved_streams - 1);
+    if (size < header)
+        throw runtime_error("interleaved streams are truncated");
+    size_t bounds[interleaved_streams + 1] = {header};
+    for (unsigned k = 0; k + 1 < interleaved_streams; ++k)
+    {
+        uint64_t length = 0;
+        for (int i = 0; i < 8; ++i)
+            length = length << 8 | data[8 * k + i];
+        if (length > size - bounds[k])
+            throw runtime_error("interleaved streams are truncated");
+        bounds[k + 1] = bounds[k] + length;
+    }
+    bounds[interleaved_streams] = size;
+    decode_streams<interleaved_streams>(data, bounds, out, count);
+}
+
+template <unsigned streams>
+void huffman_tree::decode_streams(const uint8_t* data, const size_t* bounds,
+                                  char* out, size_t count)
+{
+    /**
+     * One of the streams being decoded: its next bits are kept at the
+     * top of window, as in decode.
+     */
+    struct lane
+    {
+        size_t start;    // offset in data of the stream
+        size_t next;     // offset of the next byte to load
+        size_t end;      // offset of the stream's padding byte
+        uint64_t bits;   // bits in the stream, padding excluded
+        uint64_t window; // the next bits, first one highest
+        unsigned in_window;
+    };
+    const size_t size = bounds[streams];
+    lane lanes[streams];
+    for (unsigned k = 0; k < streams; ++k)
+    {
+        size_t start = bounds[k];
+        if (bounds[k + 1] <= start)
+            throw runtime_error("huffman stream is truncated");
+        size_t end = bounds[k + 1] - 1;
+        if (data[end] > 7 || (end == start && data[end] != 0))
+            throw runtime_error("huffman stream is corrupt");
+        lanes[k] = {start, start, end, (end - start) * 8 - data[end], 0, 0};
+    }
+
+    // a lone leaf has an empty code
+    if (!root_->left)
+    {
+        for (auto& l : lanes)
+            if (l.bits)
+                throw runtime_error("huffman stream is corrupt");
+        std::fill(out, out + count, root_->freq.character());
+        return;
+    }
+    if (table_.empty())
+        table_ = build_table();
+    const vector<decode_entry>& table = table_;
+
+    // tops the window up to between 56 and 63 bits, reading nothing past
+    // the stream (bits past it are 0)
+    auto refill = [&](lane& l)
+    {
+        while (l.in_window < 56)
+        {
+            uint64_t byte = l.next < l.end ? data[l.next] : 0;
+            l.window |= byte << (56 - l.in_window);
+            ++l.next;
+            l.in_window += 8;
+        }
+    };
+    // the same, eight bytes at once, for when they are all in data: the
+    // bits loaded past in_window are loaded again, unchanged, next time
+    auto refill_fast = [&](lane& l)
+    {
+        uint64_t bytes = 0;
+        for (int i = 0; i < 8; ++i)
+            bytes = bytes << 8 | data[l.next + i];
+        l.window |= bytes >> l.in_window;
+        l.next += (63 - l.in_window) >> 3;
+        l.in_window |= 56;
+    };
+    auto decode_one = [&](lane& l)
+    {
+        const decode_entry& entry = table[l.window >> (64 - table_bits_)];
+        if (entry.length)
+        {
+            l.window <<= entry.length;
+            l.in_window -= entry.length;
+            return entry.symbol;
+        }
+        // a long code: walk the rest of it, then make sure the window
+        // has room for the codes that follow
+        l.window <<= table_bits_;
+        l.in_window -= table_bits_;
+        const node* current = entry.next;
+        while (current->left)
+        {
+            refill(l);
+            current = l.window >> 63 ? current->right.get()
+                                     : current->left.get();
+            l.window <<= 1;
+            --l.in_window;
+        }
+        refill(l);
+        return current->freq.character();
+    };
+
+    // a refilled window holds five table-sized codes, so groups of five
+    // codes per stream can be taken without checking for the end
+    const unsigned per_refill = 57 / table_bits_;
+    const size_t group = per_refill * streams;
+    size_t i = 0;
+    auto all_in_data = [&]
+    {
+        for (auto& l : lanes)
+            if (l.next + 8 > size)
+                return false;
+        return true;
+    };
+    while (count - i >= group && all_in_data())
+    {
+        for (auto& l : lanes)
+            refill_fast(l);
+        for (unsigned j = 0; j < per_refill; ++j)
+            for (auto& l : lanes)
+                out[i++] = decode_one(l);
+    }
+    for (; i < count; ++i)
+    {
+        lane& l = lanes[i % streams];
+        refill(l);
+        out[i] = decode_one(l);
+    }
+
+    // every stream must have been used up exactly
+    for (auto& l : lanes)
+        if ((l.next - l.start) * 8 - l.in_window != l.bits)
+            throw runtime_error("huffman stream is corrupt");
+}
+
 vector<bool> huffman_tree::bits_for_char(char c)
 {
     return bits_map_[c];
 }
 
-void huffman_tree::write_tree(binary_file_writer& bfile)
+void huffman_tree::make_canonical()
 {
-    write_tree(root_.get(), bfile);
+    vector<unsigned> lengths;
+    vector<int> counts;
+    leaf_lengths(lengths, counts);
+    build_canonical(lengths, counts);
+    bits_map_.clear();
+    codes_ = {};
+    table_.clear();
+    vector<bool> path;
+    build_map(root_.get(), path);
+}
+
+void huffman_tree::limit_code_length(unsigned max_length)
+{
+    vector<unsigned> lengths;
+    vector<int> counts;
+    leaf_lengths(lengths, counts);
+    vector<unsigned> symbols;
+    for (unsigned c = 0; c < lengths.size(); ++c)
+        if (lengths[c])
+            symbols.push_back(c);
+    if (max_length == 0 || max_length > 63
+        || symbols.size() > uint64_t(1) << max_length)
+        throw invalid_argument("no prefix code has codes that short");
+    if (*std::max_element(lengths.begin(), lengths.end()) <= max_length)
+        return;
+
+    // package-merge: every character is a coin of each denomination
+    // 2^-1 ... 2^-max_length, worth its count. At each denomination
+    // from the smallest up, the cheapest pairs of what is left are
+    // packaged into coins of the next one and merged with the characters'
+    // own coins. The cheapest 2n - 2 coins of denomination 2^-1 then make
+    // up an optimal code: each character's length is the number of its
+    // coins among them.
+    struct coin
+    {
+        uint64_t weight;
+        int symbol; // -1 for a package
+        size_t first, second; // a package's contents, in coins
+    };
+    std::stable_sort(symbols.begin(), symbols.end(), [&](unsigned a, unsigned b)
+    {
+        return counts[a] < counts[b];
+    });
+    vector<coin> coins;
+    vector<size_t> leaves;
+    for (unsigned c : symbols)
+    {
+        leaves.push_back(coins.size());
+        coins.push_back({static_cast<uint64_t>(counts[c]), static_cast<int>(c), 0, 0});
+    }
+    vector<size_t> current = leaves;
+    for (unsigned level = 1; level < max_length; ++level)
+    {
+        vector<size_t> packages;
+        for (size_t i = 0; i + 1 < current.size(); i += 2)
+        {
+            packages.push_back(coins.size());
+            coins.push_back({coins[current[i]].weight
+                                 + coins[current[i + 1]].weight,
+                             -1, current[i], current[i + 1]});
+        }
+        current.clear();
+        std::merge(leaves.begin(), leaves.end(), packages.begin(),
+                   packages.end(), std::back_inserter(current),
+                   [&](size_t a, size_t b)
+                   {
+                       return coins[a].weight < coins[b].weight;
+                   });
+    }
+
+    std::fill(lengths.begin(), lengths.end(), 0);
+    vector<size_t> pending(current.begin(),
+                           current.begin() + 2 * symbols.size() - 2);
+    while (!pending.empty())
+    {
+        const coin& next = coins[pending.back()];
+        pending.pop_back();
+        if (next.symbol >= 0)
+        {
+            ++lengths[next.symbol];
+            continue;
+        }
+        pending.push_back(next.first);
+        pending.push_back(next.second);
+    }
+
+    build_canonical(lengths, counts);
+    bits_map_.clear();
+    codes_ = {};
+    table_.clear();
+    vector<bool> path;
+    build_map(root_.get(), path);
+}
+
+uint64_t huffman_tree::coded_bits() const
+{
+    vector<unsigned> lengths;
+    vector<int> counts;
+    leaf_lengths(lengths, counts);
+    uint64_t bits = 0;
+    // a lone leaf's characters take no bits at all
+    if (root_->left)
+        for (size_t c = 0; c < lengths.size(); ++c)
+            bits += uint64_t(lengths[c]) * counts[c];
+    return bits;
+}
+
+void huffman_tree::leaf_lengths(vector<unsigned>& lengths,
+                                vector<int>& counts) const
+{
+    // the depth and count of every leaf, found without recursion
+    lengths.assign(256, 0);
+    counts.assign(256, 0);
+    vector<pair<const node*, unsigned>> pending{{root_.get(), 0}};
+    while (!pending.empty())
+    {
+        const node* current = pending.back().first;
+        unsigned depth = pending.back().second;
+        pending.pop_back();
+        if (current->left)
+        {
+            pending.emplace_back(current->left.get(), depth + 1);
+            pending.emplace_back(current->right.get(), depth + 1);
+            continue;
+        }
+        uint8_t c = static_cast<uint8_t>(current->freq.character());
+        // a lone leaf's empty code is stored as length 1
+        lengths[c] = std::max(depth, 1u);
+        counts[c] = current->freq.count();
+    }
+}
+
+vector<unsigned> huffman_tree::code_lengths() const
+{
+    vector<unsigned> lengths(256, 0);
+    for (size_t c = 0; c < lengths.size(); ++c)
+        lengths[c] = codes_[c].length;
+    // a lone leaf's empty code is stored as length 1
+    if (!root_->left)
+        lengths[static_cast<uint8_t>(root_->freq.character())] = 1;
+    return lengths;
+}
+
+bool huffman_tree::canonical() const
+{
+    return canonical_;
+}
+
+void huffman_tree::build_canonical(const vector<unsigned>& lengths,
+                                   const vector<int>& counts)
+{
+    // the characters with a code, shortest code first, ties in character
+    // order (stable_sort keeps it)
+    vector<unsigned> order;
+    for (unsigned c = 0; c < lengths.size(); ++c)
+        if (lengths[c] > 0)
+            order.push_back(c);
+    std::stable_sort(order.begin(), order.end(), [&](unsigned a, unsigned b)
+    {
+        return lengths[a] < lengths[b];
+    });
+    if (order.empty())
+        throw runtime_error("huffman_tree has no characters");
+
+    canonical_ = true;
+    if (order.size() == 1)
+    {
+        root_ = std::make_unique<node>(
+            frequency(static_cast<char>(order[0]), counts[order[0]]));
+        return;
+    }
+
+    // each code is the last one plus one, shifted left to the new length
+    root_ = std::make_unique<node>(0);
+    uint64_t code = 0;
+    unsigned length = lengths[order[0]];
+    for (unsigned c : order)
+    {
+        if (lengths[c] > 63)
+            throw runtime_error("huffman codes over 63 bits are not supported");
+        code <<= lengths[c] - length;
+        length = lengths[c];
+        if (code >> length)
+            throw runtime_error("huffman code lengths are not a prefix code");
+
+        node* current = root_.get();
+        current->freq = frequency(current->freq.count() + counts[c]);
+        for (unsigned bit = length; bit-- > 0;)
+        {
+            auto& next = (code >> bit) & 1 ? current->right : current->left;
+            if (bit == 0)
+            {
+                next = std::make_unique<node>(
+                    frequency(static_cast<char>(c), counts[c]));
+                break;
+            }
+            if (!next)
+                next = std::make_unique<node>(0);
+            current = next.get();
+            current->freq = frequency(current->freq.count() + counts[c]);
+        }
+        ++code;
+    }
+    // every internal node needs both children
+    if (code != uint64_t(1) << length)
+        throw runtime_error("huffman code lengths leave codes unused");
+}
+
+vector<unsigned> huffman_tree::read_lengths(binary_file_reader& bfile,
+                                            unsigned count)
+{
+    unsigned width = read_bits(bfile, 3) + 1;
+    vector<unsigned> lengths(256, 0);
+    if (read_bits(bfile, 1) == 0)
+    {
+        for (unsigned i = 0; i < count; ++i)
+        {
+            unsigned c = read_bits(bfile, 8);
+            lengths[c] = read_bits(bfile, width);
+        }
+        return lengths;
+    }
+
+    unsigned last = 0;
+    for (unsigned c = 0; c < 256; ++c)
+    {
+        if (read_bits(bfile, 1))
+        {
+            if (read_bits(bfile, 1))
+                last = read_bits(bfile, width);
+            else
+                last = read_bits(bfile, 1) ? last - 1 : last + 1;
+        }
+        lengths[c] = last;
+    }
+    return lengths;
+}
+
+void huffman_tree::write_tree(binary_file_writer& bfile, bool as_lengths)
+{
+    if (!canonical_ || !as_lengths)
+    {
+        write_tree(root_.get(), bfile);
+        return;
+    }
+
+    vector<unsigned> lengths(256, 0);
+    unsigned count = 0;
+    unsigned longest = 1;
+    for (const auto& code : bits_map_)
+    {
+        // a lone leaf's empty code is stored as length 1
+        unsigned length = std::max<unsigned>(code.second.size(), 1);
+        lengths[static_cast<uint8_t>(code.first)] = length;
+        longest = std::max(longest, length);
+        ++count;
+    }
+    unsigned width = 1;
+    while (longest >> width)
+        ++width;
+
+    // list the characters with a code, or run through all 256 lengths,
+    // whichever is shorter
+    size_t listed = count * (8 + width);
+    size_t run = 0;
+    unsigned last = 0;
+    for (unsigned length : lengths)
+    {
+        if (length == last)
+            run += 1;
+        else if (length == last + 1 || length + 1 == last)
+            run += 3;
+        else
+            run += 2 + width;
+        last = length;
+    }
+
+    bfile.write_bit(1);
+    write_bits(bfile, count - 1, 8);
+    write_bits(bfile, width - 1, 3);
+    bfile.write_bit(run < listed);
+    if (run >= listed)
+    {
+        for (unsigned c = 0; c < 256; ++c)
+        {
+            if (lengths[c] == 0)
+                continue;
+            write_bits(bfile, c, 8);
+            write_bits(bfile, lengths[c], width);
+        }
+        return;
+    }
+
+    last = 0;
+    for (unsigned length : lengths)
+    {
+        if (length == last)
+            bfile.write_bit(0);
+        else if (length == last + 1 || length + 1 == last)
+            write_bits(bfile, length == last + 1 ? 4 : 5, 3);
+        else
+        {
+            write_bits(bfile, 3, 2);
+            write_bits(bfile, length, width);
+        }
+        last = length;
+    }
 }
 
 void huffman_tree::write_tree(node* current, binary_file_writer& bfile)
@@ -3,13 +3,74 @@
  * Contains code to test your quadtree implementation.
  */
 
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
 #include <iostream>
+#include <string>
+#include "binary_file_reader.h"
 #include "epng.h"
+#include "qtz.h"
 #include "quadtree.h"
+#include "quadtree_forest.h"
 
 using std::cout;
 using std::endl;
 
+namespace
+{
+// the checks below print nothing unless something is wrong, so the
+// expected output stays the same
+void check(bool ok, const std::string& what)
+{
+    if (!ok)
+        cout << what << endl;
+}
+
+epng::png crop(const epng::png& img, unsigned x, unsigned y, unsigned w,
+               unsigned h)
+{
+    epng::png out(w, h);
+    for (unsigned j = 0; j < h; j++)
+        for (unsigned i = 0; i < w; i++)
+            *out(i, j) = *img(x + i, y + j);
+    return out;
+}
+
+// saves a tree with each combination of .qtz flags, and checks that
+// loading it, decoding it and decoding it to a sink all give back what
+// the tree shows
+void check_qtz(const cs225::quadtree& tree, const std::string& name)
+{
+    using namespace cs225;
+    const uint8_t all_flags[] = {0, qtz::flag_entropy, qtz::flag_shared,
+                                 qtz::flag_entropy | qtz::flag_shared};
+    epng::png shown = tree.decompress();
+    for (uint8_t flags : all_flags)
+    {
+        std::string what = name + " with .qtz flags " + std::to_string(flags);
+        tree.save("check.qtz", flags);
+        quadtree loaded;
+        loaded.load("check.qtz");
+        check(loaded.decompress() == shown, what + ": load changed the image");
+        check(qtz::decode("check.qtz") == shown,
+              what + ": decode changed the image");
+
+        binary_file_reader bfile("check.qtz");
+        qtz::header hdr = qtz::read_header(bfile);
+        uint64_t covered = 0;
+        qtz::decode(bfile, hdr, [&](unsigned, unsigned, unsigned length,
+                                    const epng::rgba_pixel&)
+        {
+            covered += length;
+        });
+        check(covered == uint64_t(shown.width()) * shown.height(),
+              what + ": the spans do not cover the image once");
+    }
+    std::remove("check.qtz");
+}
+}
+
 int main()
 {
     using namespace cs225;
@@ -30,8 +91,7 @@ int main()
 
     // test pruned_size and ideal_prune (slow in valgrind, so you may want to
     // comment these out when doing most of your testing for memory leaks)
-/* 
- cout << "fullTree.pruned_size(0) = " << fullTree.pruned_size(0) << endl;
+    cout << "fullTree.pruned_size(0) = " << fullTree.pruned_size(0) << endl;
     cout << "fullTree.pruned_size(100) = " << fullTree.pruned_size(100) << endl;
     cout << "fullTree.pruned_size(1000) = " << fullTree.pruned_size(1000) << endl;
     cout << "fullTree.pruned_size(100000) = " << fullTree.pruned_size(100000)
@@ -40,7 +100,7 @@ int main()
     cout << "fullTree.ideal_prune(1000) = " << fullTree.ideal_prune(1000) << endl;
     cout << "fullTree.ideal_prune(10000) = " << fullTree.ideal_prune(10000)
          << endl;
-*/
+
     // Test some creation/deletion functions
     quadtree fullTree2;
     fullTree2 = fullTree;
@@ -75,5 +135,104 @@ fullTree.rotate_clockwise();
     tinyTree.prune(100);
     tinyTree.print();
 
+    // materialize must not change a single shown pixel, alpha included
+    // (prints nothing when it does not)
+    epng::png strip(6, 1);
+    for (size_t x = 0; x < strip.width(); x++)
+        *strip(x, 0) = epng::rgba_pixel(10, 20, 30, x < 3 ? 255 : 0);
+    quadtree stripTree(strip);
+    stripTree.flip_horizontal();
+    epng::png shown = stripTree.decompress();
+    stripTree.materialize();
+    if (!(stripTree.decompress() == shown))
+        cout << "materialize changed the image\n";
+
+    // .qtz round trips: raw, entropy coded and shared streams, of pruned,
+    // oriented, uneven, alpha and compacted trees
+    check_qtz(fullTree2, "fullTree2");
+    check_qtz(fullTree, "pruned fullTree");
+    quadtree oriented(fullTree2);
+    oriented.rotate_clockwise();
+    oriented.flip_vertical();
+    check_qtz(oriented, "rotated and flipped fullTree2");
+    quadtree uneven(imgIn, 200, 120);
+    uneven.prune(100);
+    uneven.flip_horizontal();
+    check_qtz(uneven, "uneven tree");
+    quadtree alphaTree(strip);
+    alphaTree.flip_horizontal();
+    check_qtz(alphaTree, "alpha strip");
+    quadtree compacted(fullTree);
+    compacted.compact();
+    check(compacted.decompress() == fullTree.decompress(),
+          "compact changed the image");
+    check_qtz(compacted, "compacted tree");
+    compacted.rotate_clockwise();
+    compacted.prune(10000);
+    quadtree uncompacted(fullTree);
+    uncompacted.rotate_clockwise();
+    uncompacted.prune(10000);
+    check(compacted.decompress() == uncompacted.decompress(),
+          "pruning a compacted tree gave a different image");
+
+    // regions are the same pixels decompress shows, and a scaled region of
+    // an image doubled in size is the original image
+    epng::png orientedImg = oriented.decompress();
+    check(oriented.decompress_region(37, 5, 100, 200)
+              == crop(orientedImg, 37, 5, 100, 200),
+          "decompress_region differs from decompress");
+    check(oriented.decompress_scaled(37, 5, 100, 200, 0)
+              == crop(orientedImg, 37, 5, 100, 200),
+          "decompress_scaled(0) differs from decompress");
+    epng::png doubled(2 * imgIn.width(), 2 * imgIn.height());
+    for (size_t y = 0; y < doubled.height(); y++)
+        for (size_t x = 0; x < doubled.width(); x++)
+            *doubled(x, y) = *imgIn(x / 2, y / 2);
+    quadtree doubledTree(doubled);
+    doubledTree.rotate_clockwise();
+    quadtree rotatedIn(imgIn);
+    rotatedIn.rotate_clockwise();
+    check(doubledTree.decompress_scaled(64, 32, 300, 201, 1)
+              == rotatedIn.decompress_region(32, 16, 150, 101),
+          "decompress_scaled(1) differs from the half size image");
+
+    // a forest is the image, and pruning it prunes each tile on its own;
+    // with only three trees resident, tiles are written back and the
+    // backing file compacted along the way
+    {
+        const unsigned side = 48;
+        quadtree_forest forest("in.png", "check.forest", side, 3);
+        check(forest.decompress_region(0, 0, 256, 256) == imgIn,
+              "the forest differs from the image");
+        epng::png tiled(imgIn.width(), imgIn.height());
+        for (int round = 0; round < 2; round++)
+        {
+            uint64_t leaves = 0;
+            for (unsigned y = 0; y < imgIn.height(); y += side)
+                for (unsigned x = 0; x < imgIn.width(); x += side)
+                {
+                    unsigned w = std::min<unsigned>(side, imgIn.width() - x);
+                    unsigned h = std::min<unsigned>(side, imgIn.height() - y);
+                    quadtree tile(crop(round ? tiled : imgIn, x, y, w, h));
+                    leaves += tile.pruned_size(1000);
+                    tile.prune(1000);
+                    epng::png pruned = tile.decompress();
+                    for (unsigned j = 0; j < h; j++)
+                        for (unsigned i = 0; i < w; i++)
+                            *tiled(x + i, y + j) = *pruned(i, j);
+                }
+            check(forest.pruned_size(1000) == leaves,
+                  "the forest's pruned_size differs from its tiles'");
+            forest.prune(1000);
+            check(forest.decompress_region(0, 0, 256, 256) == tiled,
+                  "the pruned forest differs from its pruned tiles");
+            check(forest.decompress_region(30, 70, 100, 50)
+                      == crop(tiled, 30, 70, 100, 50),
+                  "a forest region differs from the pruned tiles");
+        }
+        check(forest.resident() <= 3, "the forest kept too many trees");
+    }
+    std::remove("check.forest");
+
     return 0;
 }
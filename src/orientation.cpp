@@ -0,0 +1,97 @@
+/**
+ * @file orientation.cpp
+ * Implementation of the orientation class.
+ *
+ * @date Fall 2026
+ */
+
+#include <utility>
+
+#include "orientation.h"
+
+namespace cs225
+{
+
+const uint8_t orientation::transpose;
+const uint8_t orientation::mirror_x;
+const uint8_t orientation::mirror_y;
+
+orientation::orientation(uint8_t tag) : tag_{static_cast<uint8_t>(tag & 0x7)}
+{
+    /* nothing */
+}
+
+uint8_t orientation::tag() const
+{
+    return tag_;
+}
+
+bool orientation::identity() const
+{
+    return tag_ == 0;
+}
+
+void orientation::rotate_clockwise()
+{
+    // output (x, y) now shows what used to be at (y, height - 1 - x)
+    if (tag_ & transpose)
+        tag_ = (tag_ & ~transpose) ^ mirror_x;
+    else
+        tag_ = (tag_ | transpose) ^ mirror_y;
+}
+
+void orientation::flip_horizontal()
+{
+    tag_ ^= (tag_ & transpose) ? mirror_y : mirror_x;
+}
+
+void orientation::flip_vertical()
+{
+    tag_ ^= (tag_ & transpose) ? mirror_x : mirror_y;
+}
+
+void orientation::output_size(unsigned& width, unsigned& height) const
+{
+    if (tag_ & transpose)
+        std::swap(width, height);
+}
+
+void orientation::tree_pixel(unsigned& x, unsigned& y, unsigned width,
+                             unsigned height) const
+{
+    if (tag_ & transpose)
+        std::swap(x, y);
+    if (tag_ & mirror_x)
+        x = width - 1 - x;
+    if (tag_ & mirror_y)
+        y = height - 1 - y;
+}
+
+void orientation::output_rect(unsigned& x, unsigned& y, unsigned& w,
+                              unsigned& h, unsigned width,
+                              unsigned height) const
+{
+    if (tag_ & mirror_x)
+        x = width - x - w;
+    if (tag_ & mirror_y)
+        y = height - y - h;
+    if (tag_ & transpose)
+    {
+        std::swap(x, y);
+        std::swap(w, h);
+    }
+}
+
+unsigned orientation::output_quadrant(unsigned quadrant) const
+{
+    unsigned qx = quadrant & 1;
+    unsigned qy = quadrant >> 1;
+    if (tag_ & mirror_x)
+        qx ^= 1;
+    if (tag_ & mirror_y)
+        qy ^= 1;
+    if (tag_ & transpose)
+        std::swap(qx, qy);
+    return qy * 2 + qx;
+}
+}
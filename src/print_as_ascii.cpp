@@ -4,6 +4,7 @@
  * a BinaryFileWriter) as a sequence of ascii 0s and 1s.
  */
 
+#include <algorithm>
 #include <iostream>
 #include <string>
 #include <vector>
@@ -21,9 +22,23 @@ void print_usage(const std::string& name)
 void print_as_ascii(const std::string& filename)
 {
     binary_file_reader file(filename);
+    // up to 56 bits at a time, written out as one string
+    std::string line;
     while (file.has_bits())
-        std::cout << file.next_bit();
-    std::cout << std::endl;
+    {
+        unsigned n = static_cast<unsigned>(
+            std::min<std::streamoff>(56, file.bits_left()));
+        uint64_t bits = file.peek_bits(n);
+        file.consume(n);
+        for (unsigned i = n; i-- > 0;)
+            line.push_back((bits >> i) & 1 ? '1' : '0');
+        if (line.size() >= (1 << 16))
+        {
+            std::cout << line;
+            line.clear();
+        }
+    }
+    std::cout << line << std::endl;
 }
 
 int main(int argc, char** argv)
@@ -0,0 +1,258 @@
+/**
+ * @file qtree_bench.cpp
+ * Times the quadtree operations on synthetic and real images of several
+ * sizes and prints the results as JSON: nanoseconds per node, allocations
+ * and peak resident memory for each operation.
+ */
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <functional>
+#include <iostream>
+#include <new>
+#include <random>
+#include <string>
+#include <vector>
+#include <sys/resource.h>
+
+#include "epng.h"
+#include "quadtree.h"
+
+using namespace cs225;
+
+namespace
+{
+// every operator new in the program goes through these counters
+std::atomic<uint64_t> allocations{0};
+std::atomic<uint64_t> allocated_bytes{0};
+}
+
+void* operator new(std::size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    allocated_bytes.fetch_add(size, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1))
+        return p;
+    throw std::bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept
+{
+    std::free(p);
+}
+
+namespace
+{
+using clock_type = std::chrono::steady_clock;
+
+/**
+ * What one operation cost.
+ */
+struct measurement
+{
+    std::string op;
+    double ns;
+    uint64_t allocations;
+    uint64_t bytes;
+    long peak_rss_kb; // of the whole process so far
+};
+
+long peak_rss_kb()
+{
+    rusage usage;
+    getrusage(RUSAGE_SELF, &usage);
+    return usage.ru_maxrss;
+}
+
+measurement measure(const std::string& op, const std::function<void()>& run)
+{
+    uint64_t allocs = allocations.load();
+    uint64_t bytes = allocated_bytes.load();
+    auto start = clock_type::now();
+    run();
+    std::chrono::duration<double, std::nano> elapsed = clock_type::now()
+                                                       - start;
+    return {op, elapsed.count(), allocations.load() - allocs,
+            allocated_bytes.load() - bytes, peak_rss_kb()};
+}
+
+/**
+ * A smooth diagonal gradient, which prunes well.
+ */
+epng::png gradient(unsigned size)
+{
+    epng::png img(size, size);
+    for (unsigned y = 0; y < size; ++y)
+        for (unsigned x = 0; x < size; ++x)
+            *img(x, y) = epng::rgba_pixel(x * 255 / size, y * 255 / size,
+                                          (x + y) * 127 / size);
+    return img;
+}
+
+/**
+ * Uniform noise, which barely prunes at all.
+ */
+epng::png noise(unsigned size)
+{
+    epng::png img(size, size);
+    std::mt19937 rng{size};
+    for (unsigned y = 0; y < size; ++y)
+        for (unsigned x = 0; x < size; ++x)
+        {
+            uint32_t bits = rng();
+            *img(x, y) = epng::rgba_pixel(bits & 0xff, bits >> 8 & 0xff,
+                                          bits >> 16 & 0xff);
+        }
+    return img;
+}
+
+/**
+ * Flat blocks of random colours, 2 to 64 pixels on a side.
+ */
+epng::png blocks(unsigned size)
+{
+    epng::png img(size, size);
+    std::mt19937 rng{size + 1};
+    for (unsigned by = 0; by < size; by += 64)
+        for (unsigned bx = 0; bx < size; bx += 64)
+        {
+            unsigned side = 2u << rng() % 6;
+            for (unsigned y = by; y < by + 64 && y < size; ++y)
+                for (unsigned x = bx; x < bx + 64 && x < size; ++x)
+                {
+                    // a cheap integer hash of the block and cell
+                    uint32_t bits = (x / side * 73856093u)
+                                    ^ (y / side * 19349663u)
+                                    ^ (bx * 83492791u + by);
+                    bits *= 2654435761u;
+                    *img(x, y) = epng::rgba_pixel(bits >> 24, bits >> 16 & 0xff,
+                                                  bits >> 8 & 0xff);
+                }
+        }
+    return img;
+}
+
+/**
+ * A real image tiled to size x size, so any picture covers every size.
+ */
+epng::png tiled(const epng::png& source, unsigned size)
+{
+    epng::png img(size, size);
+    for (unsigned y = 0; y < size; ++y)
+        for (unsigned x = 0; x < size; ++x)
+            *img(x, y) = *source(x % source.width(), y % source.height());
+    return img;
+}
+
+/**
+ * Runs every operation on one image and prints its JSON object.
+ */
+void bench(const std::string& name, const epng::png& img, unsigned tolerance,
+           bool first)
+{
+    unsigned size = img.width();
+    // a full tree over a power of two square has (4 size^2 - 1) / 3 nodes
+    uint64_t nodes = (4 * uint64_t(size) * size - 1) / 3;
+    std::vector<measurement> results;
+
+    quadtree tree;
+    results.push_back(measure("build", [&] { tree = quadtree{img}; }));
+    quadtree copy;
+    results.push_back(measure("copy", [&] { copy = tree; }));
+    results.push_back(measure("prune", [&] { copy.prune(tolerance); }));
+    uint64_t leaves = 0;
+    results.push_back(measure("pruned_size", [&] {
+        leaves = tree.pruned_size(tolerance);
+    }));
+    uint32_t ideal = 0;
+    results.push_back(measure("ideal_prune", [&] {
+        ideal = tree.ideal_prune(leaves);
+    }));
+    results.push_back(measure("rotate", [&] {
+        tree.rotate_clockwise();
+        tree.materialize();
+    }));
+    results.push_back(measure("decompress", [&] { tree.decompress(); }));
+
+    std::cout << (first ? "" : ",\n") << "  {\"image\": \"" << name
+              << "\", \"size\": " << size << ", \"nodes\": " << nodes
+              << ", \"tolerance\": " << tolerance
+              << ", \"pruned_leaves\": " << leaves
+              << ", \"ideal_tolerance\": " << ideal << ",\n   \"ops\": [";
+    for (size_t i = 0; i < results.size(); ++i)
+    {
+        const measurement& m = results[i];
+        std::cout << (i ? ",\n    " : "\n    ") << "{\"op\": \"" << m.op
+                  << "\", \"ns\": " << uint64_t(m.ns)
+                  << ", \"ns_per_node\": " << m.ns / nodes
+                  << ", \"allocations\": " << m.allocations
+                  << ", \"allocated_bytes\": " << m.bytes
+                  << ", \"peak_rss_kb\": " << m.peak_rss_kb << "}";
+    }
+    std::cout << "]}" << std::flush;
+}
+
+void print_usage(const std::string& name)
+{
+    std::cerr << "Usage: " << name
+              << " [--max-size n] [--tolerance t] [image.png...]"
+              << "\n\tBenchmarks build, copy, prune, pruned_size, ideal_prune,"
+                 " rotate and\n\tdecompress on gradient, noise and block"
+                 " images (and each image.png,\n\ttiled) at every power of two"
+                 " size from 256 to n (default 2048),\n\tpruning with"
+                 " tolerance t (default 1000). Prints JSON. Peak memory\n\tgrows"
+                 " with n squared: about 700MB at 2048, 3GB at 4096 and\n\t11GB"
+                 " at 8192."
+              << std::endl;
+}
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> args(argv, argv + argc);
+    unsigned max_size = 2048;
+    unsigned tolerance = 1000;
+    std::vector<std::string> files;
+    for (size_t i = 1; i < args.size(); ++i)
+    {
+        if ((args[i] == "--max-size" || args[i] == "--tolerance")
+            && i + 1 < args.size())
+        {
+            unsigned value = std::stoul(args[i + 1]);
+            (args[i] == "--max-size" ? max_size : tolerance) = value;
+            ++i;
+        }
+        else if (args[i].compare(0, 2, "--") == 0)
+        {
+            print_usage(args[0]);
+            return 1;
+        }
+        else
+            files.push_back(args[i]);
+    }
+
+    std::vector<std::pair<std::string, epng::png>> sources;
+    for (auto& file : files)
+        sources.emplace_back(file, epng::png{file});
+
+    std::cout << "[\n";
+    bool first = true;
+    for (unsigned size = 256; size <= max_size; size *= 2)
+    {
+        bench("gradient", gradient(size), tolerance, first);
+        first = false;
+        bench("noise", noise(size), tolerance, false);
+        bench("blocks", blocks(size), tolerance, false);
+        for (auto& source : sources)
+            bench(source.first, tiled(source.second, size), tolerance, false);
+    }
+    std::cout << "\n]" << std::endl;
+    return 0;
+}
@@ -0,0 +1,556 @@
+/**
+ * @file qtz.cpp
+ * Implementation of the .qtz serialized quadtree image format.
+ *
+ * @date Fall 2026
+ */
+
+#include <stdexcept>
+#include <vector>
+
+#include "qtz.h"
+
+namespace cs225
+{
+namespace qtz
+{
+
+namespace
+{
+const uint8_t magic[3] = {'Q', 'T', 'Z'};
+
+void write_u32(binary_file_writer& bfile, uint32_t value)
+{
+    for (int shift = 24; shift >= 0; shift -= 8)
+        bfile.write_byte(static_cast<uint8_t>(value >> shift));
+}
+
+uint32_t read_u32(binary_file_reader& bfile)
+{
+    uint32_t value = 0;
+    for (int i = 0; i < 4; ++i)
+        value = (value << 8) | bfile.next_byte();
+    return value;
+}
+
+/**
+ * A rectangle of the image, width x height, whose node has not been read
+ * yet.
+ */
+struct pending
+{
+    unsigned x;
+    unsigned y;
+    unsigned w;
+    unsigned h;
+    epng::rgba_pixel color; // as far as it is known before it is read
+};
+
+/**
+ * A leaf of a kept subtree, relative to the subtree's corner.
+ */
+struct kept_leaf
+{
+    unsigned x;
+    unsigned y;
+    unsigned w;
+    unsigned h;
+    epng::rgba_pixel color;
+};
+
+/**
+ * A kept subtree that is still being read.
+ */
+struct recording
+{
+    size_t depth; // stack size once the subtree has been read
+    unsigned x;
+    unsigned y;
+    uint32_t index;
+};
+
+/**
+ * @return The number of bits needed to write any index below count.
+ */
+unsigned index_bits(uint32_t count)
+{
+    unsigned bits = 0;
+    while (bits < 32 && (count - 1) >> bits)
+        ++bits;
+    return bits;
+}
+
+uint8_t channel(const epng::rgba_pixel& color, unsigned c)
+{
+    switch (c)
+    {
+        case 0:
+            return color.red;
+        case 1:
+            return color.green;
+        case 2:
+            return color.blue;
+        default:
+            return color.alpha;
+    }
+}
+
+void set_channel(epng::rgba_pixel& color, unsigned c, uint8_t value)
+{
+    switch (c)
+    {
+        case 0:
+            color.red = value;
+            break;
+        case 1:
+            color.green = value;
+            break;
+        case 2:
+            color.blue = value;
+            break;
+        default:
+            color.alpha = value;
+    }
+}
+}
+
+void write_header(binary_file_writer& bfile, const header& hdr)
+{
+    for (auto m : magic)
+        bfile.write_byte(m);
+    bfile.write_byte(version);
+    bfile.write_byte(hdr.flags);
+    bfile.write_byte(hdr.orientation);
+    write_u32(bfile, hdr.width);
+    write_u32(bfile, hdr.height);
+}
+
+header read_header(binary_file_reader& bfile)
+{
+    for (auto m : magic)
+    {
+        if (!bfile.has_bytes() || bfile.next_byte() != m)
+            throw std::runtime_error{"not a qtz stream"};
+    }
+    if (bfile.next_byte() != version)
+        throw std::runtime_error{"unsupported qtz version"};
+    header hdr;
+    hdr.flags = bfile.next_byte();
+    if (hdr.flags & ~(flag_alpha | flag_entropy | flag_shared))
+        throw std::runtime_error{"unknown qtz flags"};
+    hdr.orientation = bfile.next_byte();
+    if (hdr.orientation != orientation{hdr.orientation}.tag())
+        throw std::runtime_error{"invalid qtz orientation"};
+    hdr.width = read_u32(bfile);
+    hdr.height = read_u32(bfile);
+    if ((hdr.width == 0) != (hdr.height == 0))
+        throw std::runtime_error{"invalid qtz dimensions"};
+    return hdr;
+}
+
+split::split(unsigned width, unsigned height)
+    : west{(width + 1) / 2},
+      east{width / 2},
+      north{(height + 1) / 2},
+      south{height / 2}
+{
+    /* nothing */
+}
+
+bool split::has(unsigned quadrant) const
+{
+    return ((quadrant & 1) ? east : west) != 0
+           && ((quadrant & 2) ? south : north) != 0;
+}
+
+void split::child(unsigned quadrant, unsigned& x, unsigned& y, unsigned& w,
+                  unsigned& h) const
+{
+    if (quadrant & 1)
+        x += west;
+    if (quadrant & 2)
+        y += north;
+    w = (quadrant & 1) ? east : west;
+    h = (quadrant & 2) ? south : north;
+}
+
+unsigned split::count() const
+{
+    return (east ? 2 : 1) * (south ? 2 : 1);
+}
+
+bool split::even() const
+{
+    return (east == 0 || east == west) && (south == 0 || south == north);
+}
+
+color_coder::color_coder(const header& hdr)
+    : alpha_{(hdr.flags & flag_alpha) != 0},
+      entropy_{(hdr.flags & flag_entropy) != 0}
+{
+    for (auto& histogram : counts_)
+        histogram.fill(0);
+}
+
+bool color_coder::entropy() const
+{
+    return entropy_;
+}
+
+void color_coder::count_residuals(const epng::rgba_pixel& color,
+                                  const epng::rgba_pixel& parent)
+{
+    for (unsigned c = 0; c < 3; ++c)
+        ++counts_[c][static_cast<uint8_t>(channel(color, c)
+                                          - channel(parent, c))];
+}
+
+void color_coder::count_children(const epng::rgba_pixel& parent,
+                                 const family& children, const split& shape)
+{
+    unsigned residuals = shape.count() - (shape.even() ? 1 : 0);
+    for (unsigned i = 0; i < residuals; ++i)
+        count_residuals(children[i], parent);
+}
+
+void color_coder::count_root(const epng::rgba_pixel& root)
+{
+    count_residuals(root, epng::rgba_pixel{128, 128, 128});
+}
+
+void color_coder::count_leaf(const epng::rgba_pixel& leaf)
+{
+    ++counts_[3][leaf.alpha];
+}
+
+void color_coder::write_codes(binary_file_writer& bfile)
+{
+    if (!entropy_)
+        return;
+    codes_.clear();
+    for (unsigned c = 0; c < (alpha_ ? 4u : 3u); ++c)
+    {
+        std::vector<frequency> freqs;
+        for (unsigned r = 0; r < 256; ++r)
+        {
+            if (counts_[c][r] > 0)
+                freqs.push_back(frequency(static_cast<char>(r), counts_[c][r]));
+        }
+        // a huffman_tree needs at least two symbols to give each a code
+        for (unsigned r = 0; freqs.size() < 2; ++r)
+        {
+            if (counts_[c][r] == 0)
+                freqs.push_back(frequency(static_cast<char>(r), 0));
+        }
+        codes_.emplace_back(freqs);
+        codes_.back().write_tree(bfile);
+    }
+}
+
+void color_coder::read_codes(binary_file_reader& bfile)
+{
+    if (!entropy_)
+        return;
+    codes_.clear();
+    for (unsigned c = 0; c < (alpha_ ? 4u : 3u); ++c)
+        codes_.emplace_back(bfile);
+}
+
+void color_coder::write_residuals(binary_file_writer& bfile,
+                                  const epng::rgba_pixel& color,
+                                  const epng::rgba_pixel& parent)
+{
+    for (unsigned c = 0; c < 3; ++c)
+        codes_[c].write(static_cast<char>(channel(color, c)
+                                          - channel(parent, c)),
+                        bfile);
+}
+
+epng::rgba_pixel color_coder::read_residuals(binary_file_reader& bfile,
+                                             const epng::rgba_pixel& parent)
+{
+    epng::rgba_pixel color;
+    for (unsigned c = 0; c < 3; ++c)
+        set_channel(color, c,
+                    channel(parent, c)
+                        + static_cast<uint8_t>(codes_[c].decode_char(bfile)));
+    return color;
+}
+
+void color_coder::write_root(binary_file_writer& bfile,
+                             const epng::rgba_pixel& root)
+{
+    if (entropy_)
+        write_residuals(bfile, root, epng::rgba_pixel{128, 128, 128});
+}
+
+epng::rgba_pixel color_coder::read_root(binary_file_reader& bfile)
+{
+    if (!entropy_)
+        return epng::rgba_pixel{};
+    return read_residuals(bfile, epng::rgba_pixel{128, 128, 128});
+}
+
+void color_coder::write_children(binary_file_writer& bfile,
+                                 const epng::rgba_pixel& parent,
+                                 const family& children, const split& shape)
+{
+    if (!entropy_)
+        return;
+    unsigned count = shape.count();
+    if (!shape.even())
+    {
+        for (unsigned i = 0; i < count; ++i)
+            write_residuals(bfile, children[i], parent);
+        return;
+    }
+    for (unsigned i = 0; i + 1 < count; ++i)
+        write_residuals(bfile, children[i], parent);
+    for (unsigned c = 0; c < 3; ++c)
+    {
+        int remainder = -static_cast<int>(count) * channel(parent, c);
+        for (unsigned i = 0; i < count; ++i)
+            remainder += channel(children[i], c);
+        if (remainder < 0 || remainder >= static_cast<int>(count))
+            throw std::logic_error{"node colour is not its children's average"};
+        if (count == 4)
+            bfile.write_bit(remainder & 2);
+        bfile.write_bit(remainder & 1);
+    }
+}
+
+auto color_coder::read_children(binary_file_reader& bfile,
+                                const epng::rgba_pixel& parent,
+                                const split& shape) -> family
+{
+    family children;
+    if (!entropy_)
+        return children;
+    unsigned count = shape.count();
+    if (!shape.even())
+    {
+        for (unsigned i = 0; i < count; ++i)
+            children[i] = read_residuals(bfile, parent);
+        return children;
+    }
+    for (unsigned i = 0; i + 1 < count; ++i)
+        children[i] = read_residuals(bfile, parent);
+    for (unsigned c = 0; c < 3; ++c)
+    {
+        int remainder = 0;
+        if (count == 4)
+            remainder = bfile.next_bit() << 1;
+        remainder |= bfile.next_bit();
+        int last = static_cast<int>(count) * channel(parent, c) + remainder;
+        for (unsigned i = 0; i + 1 < count; ++i)
+            last -= channel(children[i], c);
+        if (last < 0 || last > 255)
+            throw std::runtime_error{"corrupt qtz stream"};
+        set_channel(children[count - 1], c, static_cast<uint8_t>(last));
+    }
+    return children;
+}
+
+void color_coder::write_leaf(binary_file_writer& bfile,
+                             const epng::rgba_pixel& leaf)
+{
+    if (entropy_)
+    {
+        if (alpha_)
+            codes_[3].write(static_cast<char>(leaf.alpha), bfile);
+        return;
+    }
+    bfile.write_byte(leaf.red);
+    bfile.write_byte(leaf.green);
+    bfile.write_byte(leaf.blue);
+    if (alpha_)
+        bfile.write_byte(leaf.alpha);
+}
+
+epng::rgba_pixel color_coder::read_leaf(binary_file_reader& bfile,
+                                        epng::rgba_pixel known)
+{
+    if (entropy_)
+    {
+        if (alpha_)
+            known.alpha = static_cast<uint8_t>(codes_[3].decode_char(bfile));
+        return known;
+    }
+    known.red = bfile.next_byte();
+    known.green = bfile.next_byte();
+    known.blue = bfile.next_byte();
+    if (alpha_)
+        known.alpha = bfile.next_byte();
+    return known;
+}
+
+dag_writer::dag_writer(const header& hdr)
+    : enabled_{(hdr.flags & flag_shared) != 0}
+{
+    /* nothing */
+}
+
+bool dag_writer::visit(const void* node)
+{
+    if (!enabled_)
+        return true;
+    return ++visits_[node] == 1;
+}
+
+bool dag_writer::write_tag(binary_file_writer& bfile, const void* node)
+{
+    if (!enabled_)
+        return true;
+    auto found = kept_.find(node);
+    if (found != kept_.end())
+    {
+        bfile.write_bit(true);
+        bfile.write_bit(true);
+        unsigned bits = index_bits(static_cast<uint32_t>(kept_.size()));
+        for (unsigned i = bits; i-- > 0;)
+            bfile.write_bit((found->second >> i) & 1);
+        return false;
+    }
+    if (visits_[node] > 1)
+    {
+        bfile.write_bit(true);
+        bfile.write_bit(false);
+        uint32_t index = static_cast<uint32_t>(kept_.size());
+        kept_[node] = index;
+    }
+    else
+        bfile.write_bit(false);
+    return true;
+}
+
+dag_reader::dag_reader(const header& hdr)
+    : enabled_{(hdr.flags & flag_shared) != 0}, kept_{0}
+{
+    /* nothing */
+}
+
+node_tag dag_reader::read_tag(binary_file_reader& bfile, uint32_t& index)
+{
+    if (!enabled_)
+        return node_tag::plain;
+    if (!bfile.has_bits())
+        throw std::runtime_error{"qtz stream ended early"};
+    if (!bfile.next_bit())
+        return node_tag::plain;
+    if (!bfile.next_bit())
+    {
+        index = kept_++;
+        return node_tag::kept;
+    }
+    if (kept_ == 0)
+        throw std::runtime_error{"corrupt qtz stream"};
+    index = 0;
+    for (unsigned i = index_bits(kept_); i-- > 0;)
+        index = (index << 1) | bfile.next_bit();
+    if (index >= kept_)
+        throw std::runtime_error{"corrupt qtz stream"};
+    return node_tag::reference;
+}
+
+void decode(binary_file_reader& bfile, const header& hdr,
+            const span_sink& sink)
+{
+    if (hdr.width == 0)
+        return;
+
+    color_coder coder{hdr};
+    coder.read_codes(bfile);
+    orientation orient{hdr.orientation};
+    dag_reader dag{hdr};
+
+    // kept subtrees are remembered as their leaves, so a reference can be
+    // replayed without building any nodes
+    std::vector<std::vector<kept_leaf>> kept;
+    std::vector<recording> recordings;
+    auto emit = [&](unsigned x, unsigned y, unsigned w, unsigned h,
+                    const epng::rgba_pixel& color)
+    {
+        for (const auto& rec : recordings)
+            kept[rec.index].push_back({x - rec.x, y - rec.y, w, h, color});
+        orient.output_rect(x, y, w, h, hdr.width, hdr.height);
+        for (unsigned row = 0; row < h; ++row)
+            sink(x, y + row, w, color);
+    };
+
+    std::vector<pending> stack{
+        {0, 0, hdr.width, hdr.height, coder.read_root(bfile)}};
+    while (!stack.empty())
+    {
+        auto rect = stack.back();
+        stack.pop_back();
+
+        bool pixel = rect.w == 1 && rect.h == 1;
+        if (!pixel && !bfile.has_bits())
+            throw std::runtime_error{"qtz stream ended early"};
+        if (pixel || !bfile.next_bit())
+        {
+            emit(rect.x, rect.y, rect.w, rect.h,
+                 coder.read_leaf(bfile, rect.color));
+        }
+        else
+        {
+            uint32_t index;
+            auto tag = dag.read_tag(bfile, index);
+            if (tag == node_tag::reference)
+            {
+                // a subtree still being read cannot be a copy of itself
+                for (const auto& rec : recordings)
+                {
+                    if (rec.index == index)
+                        throw std::runtime_error{"corrupt qtz stream"};
+                }
+                for (const auto& leaf : kept[index])
+                    emit(rect.x + leaf.x, rect.y + leaf.y, leaf.w, leaf.h,
+                         leaf.color);
+            }
+            else
+            {
+                if (tag == node_tag::kept)
+                {
+                    kept.emplace_back();
+                    recordings.push_back(
+                        {stack.size(), rect.x, rect.y, index});
+                }
+                split shape{rect.w, rect.h};
+                auto children = coder.read_children(bfile, rect.color, shape);
+                // push in reverse so northwest is read first
+                unsigned i = shape.count();
+                for (unsigned q = 4; q-- > 0;)
+                {
+                    if (!shape.has(q))
+                        continue;
+                    pending child{rect.x, rect.y, 0, 0, children[--i]};
+                    shape.child(q, child.x, child.y, child.w, child.h);
+                    stack.push_back(child);
+                }
+            }
+        }
+
+        while (!recordings.empty() && stack.size() <= recordings.back().depth)
+            recordings.pop_back();
+    }
+}
+
+epng::png decode(const std::string& file_name)
+{
+    binary_file_reader bfile(file_name);
+    auto hdr = read_header(bfile);
+    unsigned width = hdr.width;
+    unsigned height = hdr.height;
+    orientation{hdr.orientation}.output_size(width, height);
+    epng::png img(width, height);
+    decode(bfile, hdr, [&](unsigned x, unsigned y, unsigned length,
+                           const epng::rgba_pixel& color)
+    {
+        for (unsigned i = 0; i < length; ++i)
+            *img(x + i, y) = color;
+    });
+    return img;
+}
+}
+}
@@ -0,0 +1,135 @@
+/**
+ * @file qtz_bench.cpp
+ * Compares the size and speed of saving pruned quadtrees as png, raw .qtz,
+ * entropy coded .qtz and compacted, entropy coded .qtz files.
+ */
+
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include "epng.h"
+#include "qtz.h"
+#include "quadtree.h"
+
+using namespace cs225;
+
+namespace
+{
+using clock_type = std::chrono::steady_clock;
+
+double ms_since(clock_type::time_point start)
+{
+    std::chrono::duration<double, std::milli> elapsed = clock_type::now()
+                                                        - start;
+    return elapsed.count();
+}
+
+std::streamoff file_size(const std::string& file_name)
+{
+    std::ifstream file{file_name, std::ios::binary | std::ios::ate};
+    return file.tellg();
+}
+
+void print_row(const std::string& format, std::streamoff size,
+               std::streamoff png_size, double encode_ms, double decode_ms)
+{
+    std::cout << std::setw(10) << format << std::setw(12) << size
+              << std::setw(10) << std::fixed << std::setprecision(3)
+              << static_cast<double>(size) / png_size << std::setw(12)
+              << std::setprecision(2) << encode_ms << std::setw(12)
+              << decode_ms << "\n";
+}
+
+void print_usage(const std::string& name)
+{
+    std::cout << "Usage: " << name << " image.png size [tolerance...]"
+              << "\n\tBuilds a size x size quadtree of image.png, prunes it"
+                 " with each tolerance\n\t(default 0 1000 10000) and compares"
+                 " the png, raw .qtz, entropy\n\tcoded .qtz and compacted .qtz"
+                 " outputs."
+              << std::endl;
+}
+}
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> args(argv, argv + argc);
+    if (args.size() < 3)
+    {
+        print_usage(args[0]);
+        return 1;
+    }
+
+    epng::png source{args[1]};
+    unsigned size = std::stoul(args[2]);
+    std::vector<unsigned> tolerances;
+    for (size_t i = 3; i < args.size(); ++i)
+        tolerances.push_back(std::stoul(args[i]));
+    if (tolerances.empty())
+        tolerances = {0, 1000, 10000};
+
+    quadtree full{source, size};
+    for (auto tolerance : tolerances)
+    {
+        quadtree tree{full};
+        tree.prune(tolerance);
+        std::cout << "tolerance " << tolerance << ", " << tree.pruned_size(0)
+                  << " leaves\n";
+        std::cout << std::setw(10) << "format" << std::setw(12) << "bytes"
+                  << std::setw(10) << "vs png" << std::setw(12) << "enc ms"
+                  << std::setw(12) << "dec ms" << "\n";
+
+        auto start = clock_type::now();
+        auto img = tree.decompress();
+        img.save("bench.png");
+        double png_encode = ms_since(start);
+        start = clock_type::now();
+        epng::png png_in{"bench.png"};
+        double png_decode = ms_since(start);
+        auto png_size = file_size("bench.png");
+        print_row("png", png_size, png_size, png_encode, png_decode);
+
+        start = clock_type::now();
+        tree.save("bench.qtz");
+        double raw_encode = ms_since(start);
+        start = clock_type::now();
+        auto raw_in = qtz::decode("bench.qtz");
+        double raw_decode = ms_since(start);
+        print_row("qtz", file_size("bench.qtz"), png_size, raw_encode,
+                  raw_decode);
+
+        start = clock_type::now();
+        tree.save("bench.qtze", qtz::flag_entropy);
+        double entropy_encode = ms_since(start);
+        start = clock_type::now();
+        auto entropy_in = qtz::decode("bench.qtze");
+        double entropy_decode = ms_since(start);
+        print_row("qtz+huff", file_size("bench.qtze"), png_size,
+                  entropy_encode, entropy_decode);
+
+        quadtree dag{tree};
+        start = clock_type::now();
+        dag.compact();
+        dag.save("bench.qtzd", qtz::flag_entropy | qtz::flag_shared);
+        double dag_encode = ms_since(start);
+        start = clock_type::now();
+        auto dag_in = qtz::decode("bench.qtzd");
+        double dag_decode = ms_since(start);
+        print_row("qtz+dag", file_size("bench.qtzd"), png_size, dag_encode,
+                  dag_decode);
+
+        if (raw_in != img || entropy_in != img || dag_in != img)
+        {
+            std::cerr << "decoded image differs from decompress()"
+                      << std::endl;
+            return 1;
+        }
+        std::cout << std::endl;
+    }
+    return 0;
+}
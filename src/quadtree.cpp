@@ -7,50 +7,110 @@
 
 #include "quadtree.h"
 #include <iostream>
+#include <algorithm>
+#include <atomic>
 #include <cmath>
+#include <cstring>
+#include <future>
+#include <stdexcept>
 #include <stdint.h>
+#include <thread>
+#include <vector>
 using std::cout;
 using std::endl;
 namespace cs225
 {
 
-quadtree::node::node(node &other){//deep copy of the quadtree:
-	length_ = other.length_;
-	element = other.element;
-	if (other.northwest) northwest = std::unique_ptr<node>(new node(*other.northwest.get()));
-	if (other.northeast) northeast = std::unique_ptr<node>(new node(*other.northeast.get()));
-	if (other.southwest) southwest = std::unique_ptr<node>(new node(*other.southwest.get()));
-	if (other.southeast) southeast = std::unique_ptr<node>(new node(*other.southeast.get()));
+namespace
+{
+//trees at least this wide or high decompress their top level quadrants in parallel
+const unsigned parallel_decompress_res = 256;
+
+//sample() stops partitioning the points once a node has this few of them
+const long sample_walk_limit = 16;
+
+//how many levels of prune() and pruned_size() hand their children to separate
+//tasks: enough for each core to get a couple of subtrees, none for small trees
+unsigned parallel_prune_levels(unsigned width, unsigned height){
+	unsigned cores = std::thread::hardware_concurrency();
+	if (cores < 2 || std::max(width, height) < parallel_decompress_res) return 0;
+	unsigned levels = 1;
+	while (levels < 4 && (1u << (2 * levels)) < 2 * cores) levels++;
+	return levels;
+}
+
+//calls visit(q) for every quadrant; quadrants 1 to 3 run on their own tasks when
+//parallel, and every call has finished when this returns
+template <class Visit>
+void each_quadrant(bool parallel, const Visit& visit){
+	if (!parallel){
+		for (unsigned q = 0; q < 4; q++) visit(q);
+		return;
+	}
+	std::future<void> quadrants[3];
+	for (unsigned q = 1; q < 4; q++)
+		quadrants[q - 1] = std::async(std::launch::async, [&visit, q]{ visit(q); });
+	visit(0);
+	for (auto& quadrant : quadrants) quadrant.get();
+}
+
+bool power_of_two(unsigned n){
+	return n != 0 && (n & (n - 1)) == 0;
+}
+
+//writes one pixel, then keeps doubling the filled prefix with memcpy, so long
+//spans are written as wide block copies rather than one pixel at a time
+void fill_span(epng::rgba_pixel* dst, unsigned length, const epng::rgba_pixel& color){
+	if (length == 0) return;
+	dst[0] = color;
+	unsigned filled = 1;
+	while (filled < length){
+		unsigned n = std::min(filled, length - filled);
+		std::memcpy(dst + filled, dst, n * sizeof(epng::rgba_pixel));
+		filled += n;
+	}
+}
 }
 
+quadtree::quadtree():root_{nullptr}, width_{0}, height_{0}{
+}
 
-quadtree::quadtree():root_{nullptr}, res_{ 0}{
+quadtree::quadtree(const epng::png& source){
+	build_tree(source);
 }
 
 quadtree::quadtree(const epng::png& source, unsigned d){
 	build_tree(source, d);
 }
 
+quadtree::quadtree(const epng::png& source, unsigned width, unsigned height){
+	build_tree(source, width, height);
+}
+
+quadtree::quadtree(epng::row_reader& rows, unsigned band_rows){
+	build_tree(rows, band_rows);
+}
+
 quadtree::quadtree(const quadtree &other){
-	if (other.root_) {
-	root_ = std::unique_ptr<node>(new node(*other.root_));
-	res_ = other.res_;
-	}
-	else if (!(other.root_)) {
-		root_ = nullptr; 
-		res_ = 0;
-	}
-}//TODO: there is a bug in copy ctor. go fix it!
+	//O(1): the nodes are shared until one of the trees changes them
+	root_ = other.root_;
+	width_ = other.width_;
+	height_ = other.height_;
+	orientation_ = other.orientation_;
+}
 
 quadtree::quadtree(quadtree &&other){
 	root_ = nullptr;
-	res_ = 0;
+	width_ = 0;
+	height_ = 0;
 	swap(other);
 }
 
 void quadtree::swap(quadtree &other){
 	std::swap(root_, other.root_);
-	std::swap(res_, other.res_);
+	std::swap(width_, other.width_);
+	std::swap(height_, other.height_);
+	std::swap(orientation_, other.orientation_);
 }
 
 quadtree& quadtree::operator=(quadtree other){
@@ -58,191 +118,649 @@ quadtree& quadtree::operator=(quadtree other){
 	return *this;
 }
 
+void quadtree::build_tree(const epng::png& source){
+	build_tree(source, source.width(), source.height());
+}
+
 void quadtree::build_tree(const epng::png& source, unsigned d){
+	build_tree(source, d, d);
+}
+
+void quadtree::build_tree(const epng::png& source, unsigned width, unsigned height){
 	//recursively define downwards, and fix element_ to its child averge on the way back
-	res_ = d;
-	if (d == 0) return;
-	root_ = std::move(std::unique_ptr<node>(new node(source, 0, 0, d))); //move assignment... delete original
+	orientation_ = orientation();
+	if (width == 0 || height == 0){
+		root_ = nullptr;
+		width_ = height_ = 0;
+		return;
+	}
+	width_ = width;
+	height_ = height;
+	root_ = std::make_shared<node>(source, 0, 0, width, height);
 }
 
-quadtree::node::node(const epng::png& source, unsigned x, unsigned y, unsigned d){
-	if (d == 1) {
-		length_ = 1;
+void quadtree::build_tree(epng::row_reader& rows, unsigned band_rows){
+	if (rows.rows_read() != 0)
+		throw std::invalid_argument("build_tree() needs a row_reader at the first row");
+	orientation_ = orientation();
+	root_ = nullptr;
+	width_ = height_ = 0;
+	if (rows.width() == 0 || rows.height() == 0) return;
+	unsigned width = rows.width(), height = rows.height();
+	band_rows = std::max(1u, std::min(band_rows, height));
+	epng::png band(width, band_rows);
+	root_ = build_rows(rows, band, band_rows, {{0, width}}, height)[0];
+	width_ = width;
+	height_ = height;
+}
+
+auto quadtree::build_rows(epng::row_reader& rows, epng::png& band, unsigned band_rows,
+			  const std::vector<std::pair<unsigned, unsigned>>& columns,
+			  unsigned h) ->std::vector<std::shared_ptr<node>>{
+	//every node of a level has the same rows, so a level is a row of columns
+	std::vector<std::shared_ptr<node>> level(columns.size());
+	if (h <= band_rows){
+		for (unsigned j = 0; j < h; j++) rows.read_row(band.row(j));
+		for (size_t i = 0; i < columns.size(); i++)
+			if (columns[i].second != 0)
+				level[i] = std::make_shared<node>(band, columns[i].first, 0,
+								  columns[i].second, h);
+		return level;
+	}
+
+	//too tall for the band: build the north and then the south half of the
+	//level below (each column split in two, as qtz::split does), then join
+	//them; only the northern nodes wait while the south is read
+	std::vector<std::pair<unsigned, unsigned>> halves;
+	halves.reserve(2 * columns.size());
+	for (auto& column : columns){
+		qtz::split s(column.second, h);
+		halves.emplace_back(column.first, s.west);
+		halves.emplace_back(column.first + s.west, s.east);
+	}
+	unsigned north = qtz::split(1, h).north;
+	auto top = build_rows(rows, band, band_rows, halves, north);
+	auto bottom = build_rows(rows, band, band_rows, halves, h - north);
+	for (size_t i = 0; i < columns.size(); i++){
+		if (columns[i].second == 0) continue;
+		level[i] = std::make_shared<node>();
+		node* n = level[i].get();
+		n->northwest = std::move(top[2 * i]);
+		n->northeast = std::move(top[2 * i + 1]);
+		n->southwest = std::move(bottom[2 * i]);
+		n->southeast = std::move(bottom[2 * i + 1]);
+		n->average_children(columns[i].second, h);
+	}
+	return level;
+}
+
+quadtree::node::node(const epng::png& source, unsigned x, unsigned y, unsigned w, unsigned h){
+	if (w == 1 && h == 1) {
 		element = *source(x, y);
 		return;
 	}
-	else {
-		//std::cout<<"current d is: "<<d<<endl;
-		length_ = d;
-		d = d/2;
-		northwest = std::unique_ptr<node>(new node(source, x, y, d));
-		northeast = std::unique_ptr<node>(new node(source, x+d, y, d));
-		southwest = std::unique_ptr<node>(new node(source, x, y+d, d));
-		southeast = std::unique_ptr<node>(new node(source, x+d, y+d, d));
-
-		element.red = (northwest->element.red +
-					northeast->element.red +
-					southwest->element.red +
-					southeast->element.red)/4;
-		element.green = (northwest->element.green +
-					northeast->element.green +
-					southwest->element.green +
-					southeast->element.green)/4;	
-		element.blue =  (northwest->element.blue +
-					northeast->element.blue +
-					southwest->element.blue +
-					southeast->element.blue)/4;
+	//odd sides give the extra pixel to the west and north children, and a
+	//side of 1 leaves the eastern or southern children out (see qtz::split)
+	qtz::split s(w, h);
+	for (unsigned q = 0; q < 4; q++){
+		if (!s.has(q)) continue;
+		unsigned cx = x, cy = y, cw, ch;
+		s.child(q, cx, cy, cw, ch);
+		child(q) = std::make_shared<node>(source, cx, cy, cw, ch);
 	}
+	average_children(w, h);
 }
 
-const epng::rgba_pixel& quadtree::operator()(unsigned x, unsigned y)const{
-	return root_.get()->nodeFinder(x,y)->element;
+auto quadtree::node::child(unsigned quadrant) ->std::shared_ptr<node>&{
+	switch (quadrant){
+		case 0: return northwest;
+		case 1: return northeast;
+		case 2: return southwest;
+		default: return southeast;
+	}
 }
 
-auto quadtree::node::nodeFinder(unsigned x, unsigned y)const ->node*{
-	bool north = false;
-	bool west = false;
-	if (x <  length_/2){
-		west = true;
+auto quadtree::node::child(unsigned quadrant)const ->const std::shared_ptr<node>&{
+	return const_cast<node*>(this)->child(quadrant);
+}
+
+void quadtree::node::average_children(unsigned w, unsigned h){
+	//weighted by area, so uneven children count for the pixels they cover
+	qtz::split s(w, h);
+	uint64_t red = 0, green = 0, blue = 0;
+	for (unsigned q = 0; q < 4; q++){
+		if (!s.has(q)) continue;
+		unsigned cx = 0, cy = 0, cw, ch;
+		s.child(q, cx, cy, cw, ch);
+		uint64_t area = uint64_t(cw) * ch;
+		red += area * child(q)->element.red;
+		green += area * child(q)->element.green;
+		blue += area * child(q)->element.blue;
 	}
-	else if (length_/2 <= x && x < length_){
-		west = false;
-		x = x - length_/2;
+	uint64_t area = uint64_t(w) * h;
+	element.red = red / area;
+	element.green = green / area;
+	element.blue = blue / area;
+}
+
+const epng::rgba_pixel& quadtree::operator()(unsigned x, unsigned y)const{
+	unsigned w = width_, h = height_;
+	orientation_.output_size(w, h);
+	if (x >= w || y >= h) throw std::out_of_range("access out of range");
+	orientation_.tree_pixel(x, y, width_, height_);
+	return root_.get()->nodeFinder(x, y, width_, height_)->element;
+}
+
+auto quadtree::node::nodeFinder(unsigned x, unsigned y, unsigned w, unsigned h)const ->const node*{
+	//(x, y) is known to be inside, so this just walks down, one level per step
+	const node* n = this;
+	if (power_of_two(w) && power_of_two(h)){
+		//every split is exact, so the quadrant at each level is one bit of x
+		//and one of y (no bit once that side is down to a single pixel)
+		unsigned bx = w >> 1, by = h >> 1;
+		while (n->northwest){
+			n = n->child((x & bx ? 1 : 0) | (y & by ? 2 : 0)).get();
+			bx >>= 1;
+			by >>= 1;
+		}
+		return n;
 	}
-	else throw std::out_of_range("duh, access x out of range");
-	
-	if (y < length_/2){
-		north = true;
+	while (n->northwest){
+		unsigned west = (w + 1)/2, north = (h + 1)/2;
+		unsigned q = 0;
+		if (x < west) w = west;
+		else { x -= west; w -= west; q |= 1; }
+		if (y < north) h = north;
+		else { y -= north; h -= north; q |= 2; }
+		n = n->child(q).get();
 	}
-	else if (length_/2 <= y && y < length_){
-		north = false;
-		y = y - length_/2;
+	return n;
+}
+
+std::vector<epng::rgba_pixel> quadtree::sample(const std::vector<std::pair<unsigned, unsigned>>& points)const{
+	if (!root_ && !points.empty()) throw std::out_of_range("access out of range");
+	unsigned w = width_, h = height_;
+	orientation_.output_size(w, h);
+
+	//tree coordinates of every point, kept together with where its colour goes
+	std::vector<sample_point> todo(points.size());
+	for (size_t i = 0; i < points.size(); i++){
+		unsigned x = points[i].first, y = points[i].second;
+		if (x >= w || y >= h) throw std::out_of_range("access out of range");
+		orientation_.tree_pixel(x, y, width_, height_);
+		todo[i] = sample_point{x, y, static_cast<uint32_t>(i)};
 	}
-	else throw std::out_of_range("duh, access y out of range");
-	
-	if (north && west) return northwest->nodeFinder(x, y);
-	else if (north && !west) return northeast->nodeFinder(x, y);
-	else if (!north && west) return southwest->nodeFinder(x, y);
-	else if (!north && !west) return southeast->nodeFinder(x, y);
-	else throw std::runtime_error("out of control flow in nodeFinder()");
+	std::vector<epng::rgba_pixel> out(points.size());
+	if (!todo.empty())
+		root_->sampleFinder(todo.data(), todo.data() + todo.size(), 0, 0, width_, height_,
+				    out.data());
+	return out;
+}
 
+void quadtree::node::sampleFinder(sample_point* first, sample_point* last, unsigned x,
+				  unsigned y, unsigned w, unsigned h, epng::rgba_pixel* out)const{
+	if (!northwest){
+		for (auto p = first; p != last; p++) out[p->index] = element;
+		return;
+	}
+	if (last - first <= sample_walk_limit){
+		//too few to be worth sorting: walk down from here for each
+		for (auto p = first; p != last; p++)
+			out[p->index] = nodeFinder(p->x - x, p->y - y, w, h)->element;
+		return;
+	}
+	//split the points by column, then each half by row, so every child gets
+	//one contiguous run of them and each node is visited once
+	qtz::split s(w, h);
+	unsigned mid_x = x + s.west, mid_y = y + s.north;
+	auto north = [&](const sample_point& p){ return p.y < mid_y; };
+	sample_point* east = std::partition(first, last, [&](const sample_point& p){ return p.x < mid_x; });
+	//bounds runs NW, SW, NE, SE
+	sample_point* bounds[5] = {first, std::partition(first, east, north), east,
+				   std::partition(east, last, north), last};
+	const unsigned quadrants[4] = {0, 2, 1, 3};
+	for (unsigned k = 0; k < 4; k++){
+		if (bounds[k] == bounds[k + 1]) continue;
+		unsigned q = quadrants[k];
+		unsigned cx = x, cy = y, cw, ch;
+		s.child(q, cx, cy, cw, ch);
+		child(q)->sampleFinder(bounds[k], bounds[k + 1], cx, cy, cw, ch, out);
+	}
 }
 
 epng::png quadtree::decompress()const{
 	if (!root_) throw std::runtime_error("tree empty, cannot decompress()");
-	epng::png ret(res_, res_);
-	root_.get()->colorFiller(ret, 0, 0);
-//	cout<<root_.get()->element.red<<endl;
+	unsigned w = width_, h = height_;
+	orientation_.output_size(w, h);
+	epng::png ret(w, h);
+	const node* root = root_.get();
+	if (!root->northwest || std::max(width_, height_) < parallel_decompress_res){
+		root->colorFiller(ret, 0, 0, width_, height_, orientation_, width_, height_);
+		return ret;
+	}
+
+	//the quadrants cover disjoint pixels, so they can be filled concurrently
+	qtz::split s(width_, height_);
+	std::vector<std::future<void>> quadrants;
+	for (unsigned q = 1; q < 4; q++){
+		if (!s.has(q)) continue;
+		quadrants.push_back(std::async(std::launch::async, [&, q]{
+			unsigned x = 0, y = 0, cw, ch;
+			s.child(q, x, y, cw, ch);
+			root->child(q)->colorFiller(ret, x, y, cw, ch, orientation_, width_, height_);
+		}));
+	}
+	root->northwest->colorFiller(ret, 0, 0, s.west, s.north, orientation_, width_, height_);
+	for (auto& quadrant : quadrants) quadrant.get();
 	return ret;
 }
 
-void quadtree::node::colorFiller(epng::png& output, unsigned x, unsigned y){
+void quadtree::node::colorFiller(epng::png& output, unsigned x, unsigned y, unsigned w,
+				 unsigned h, const orientation& o, unsigned width,
+				 unsigned height)const{
 	//base case is when all of its child is nullptr
 	if (!northwest){//others should be null too! maybe leave a test here?
 	//	cout<<"current r, g are: "<<element.red<<", "<<int(element.blue)<<endl;
-		for (unsigned i = 0; i < length_; i++){
-			for (unsigned j = 0; j < length_; j++){
-				*output(i+x, j+y) = element;
-				}
-			}
+		//fill the top row of the rectangle, then copy it into the rows below
+		o.output_rect(x, y, w, h, width, height);
+		epng::rgba_pixel* first = output.row(y) + x;
+		fill_span(first, w, element);
+		for (unsigned j = 1; j < h; j++)
+			std::memcpy(output.row(y+j) + x, first, w * sizeof(epng::rgba_pixel));
 	}
 	else {
 		//cout<<"non operational x y: "<<x_<<", "<<y_<<endl;
-		northwest->colorFiller(output, x, y);
-		northeast->colorFiller(output, x+length_/2, y);
-		southwest->colorFiller(output, x, y + length_/2);
-		southeast->colorFiller(output, x+length_/2, y+length_/2);
+		qtz::split s(w, h);
+		for (unsigned q = 0; q < 4; q++){
+			if (!s.has(q)) continue;
+			unsigned cx = x, cy = y, cw, ch;
+			s.child(q, cx, cy, cw, ch);
+			child(q)->colorFiller(output, cx, cy, cw, ch, o, width, height);
+		}
 	}
 }
 
+void quadtree::write(binary_file_writer& bfile, uint8_t flags)const{
+	qtz::header hdr{width_, height_, flags, orientation_.tag()};
+	if (root_ && root_->has_alpha()) hdr.flags |= qtz::flag_alpha;
+	qtz::write_header(bfile, hdr);
+	if (!root_) return;
+
+	qtz::color_coder coder(hdr);
+	qtz::dag_writer dag(hdr);
+	if (coder.entropy() || (hdr.flags & qtz::flag_shared)) {
+		coder.count_root(root_->element);
+		root_->count_colors(coder, dag, width_, height_);
+	}
+	coder.write_codes(bfile);
+	coder.write_root(bfile, root_->element);
+	root_->write_node(bfile, coder, dag, width_, height_);
+}
+
+void quadtree::read(binary_file_reader& bfile){
+	auto hdr = qtz::read_header(bfile);
+	quadtree tmp;
+	tmp.width_ = hdr.width;
+	tmp.height_ = hdr.height;
+	tmp.orientation_ = orientation(hdr.orientation);
+	if (hdr.width != 0) {
+		qtz::color_coder coder(hdr);
+		coder.read_codes(bfile);
+		qtz::dag_reader dag(hdr);
+		std::vector<std::shared_ptr<node>> kept;
+		auto root = coder.read_root(bfile);
+		tmp.root_ = node::read_node(bfile, coder, dag, kept, root, hdr.width, hdr.height);
+	}
+	swap(tmp);
+}
+
+void quadtree::save(const std::string& file_name, uint8_t flags)const{
+	binary_file_writer bfile(file_name);
+	write(bfile, flags);
+}
+
+void quadtree::load(const std::string& file_name){
+	binary_file_reader bfile(file_name);
+	read(bfile);
+}
+
+auto quadtree::node::children_colors()const ->qtz::color_coder::family{
+	qtz::color_coder::family colors;
+	unsigned i = 0;
+	for (unsigned q = 0; q < 4; q++)
+		if (child(q)) colors[i++] = child(q)->element;
+	return colors;
+}
+
+void quadtree::node::count_colors(qtz::color_coder& coder, qtz::dag_writer& dag,
+				  unsigned w, unsigned h)const{
+	if (!northwest){
+		coder.count_leaf(element);
+		return;
+	}
+	//must skip exactly the subtrees write_node skips
+	if (!dag.visit(this)) return;
+	qtz::split s(w, h);
+	coder.count_children(element, children_colors(), s);
+	for (unsigned q = 0; q < 4; q++){
+		if (!s.has(q)) continue;
+		unsigned cx = 0, cy = 0, cw, ch;
+		s.child(q, cx, cy, cw, ch);
+		child(q)->count_colors(coder, dag, cw, ch);
+	}
+}
+
+void quadtree::node::write_node(binary_file_writer& bfile, qtz::color_coder& coder,
+				qtz::dag_writer& dag, unsigned w, unsigned h)const{
+	//preorder; a single pixel is always a leaf so it needs no structure bit
+	if (!northwest){
+		if (w > 1 || h > 1) bfile.write_bit(0);
+		coder.write_leaf(bfile, element);
+		return;
+	}
+	bfile.write_bit(1);
+	if (!dag.write_tag(bfile, this)) return;
+	qtz::split s(w, h);
+	coder.write_children(bfile, element, children_colors(), s);
+	for (unsigned q = 0; q < 4; q++){
+		if (!s.has(q)) continue;
+		unsigned cx = 0, cy = 0, cw, ch;
+		s.child(q, cx, cy, cw, ch);
+		child(q)->write_node(bfile, coder, dag, cw, ch);
+	}
+}
+
+auto quadtree::node::read_node(binary_file_reader& bfile, qtz::color_coder& coder,
+			       qtz::dag_reader& dag, std::vector<std::shared_ptr<node>>& kept,
+			       const epng::rgba_pixel& known, unsigned w, unsigned h) ->std::shared_ptr<node>{
+	auto n = std::make_shared<node>();
+	bool pixel = w == 1 && h == 1;
+	if (!pixel && !bfile.has_bits()) throw std::runtime_error("qtz stream ended early");
+	if (pixel || !bfile.next_bit()){
+		n->element = coder.read_leaf(bfile, known);
+		return n;
+	}
+	uint32_t index;
+	auto tag = dag.read_tag(bfile, index);
+	if (tag == qtz::node_tag::reference){
+		//a node still being read cannot be a copy of itself
+		if (!kept[index]) throw std::runtime_error("corrupt qtz stream");
+		return kept[index];
+	}
+	if (tag == qtz::node_tag::kept) kept.emplace_back();
+	qtz::split s(w, h);
+	auto children = coder.read_children(bfile, known, s);
+	unsigned i = 0;
+	for (unsigned q = 0; q < 4; q++){
+		if (!s.has(q)) continue;
+		unsigned cx = 0, cy = 0, cw, ch;
+		s.child(q, cx, cy, cw, ch);
+		n->child(q) = read_node(bfile, coder, dag, kept, children[i++], cw, ch);
+	}
+	n->average_children(w, h);
+	if (tag == qtz::node_tag::kept) kept[index] = n;
+	return n;
+}
+
+bool quadtree::node::has_alpha()const{
+	if (!northwest) return element.alpha != 255;
+	for (unsigned q = 0; q < 4; q++)
+		if (child(q) && child(q)->has_alpha()) return true;
+	return false;
+}
+
+epng::png quadtree::decompress_region(unsigned x, unsigned y, unsigned w, unsigned h)const{
+	return decompress(region{x, y, w, h, 0});
+}
+
+epng::png quadtree::decompress_scaled(unsigned x, unsigned y, unsigned w, unsigned h,
+				      unsigned scale)const{
+	if (scale >= 32) throw std::out_of_range("scale too large");
+	return decompress(region{x, y, w, h, scale});
+}
+
+epng::png quadtree::decompress(const region& r)const{
+	if (!root_) throw std::runtime_error("tree empty, cannot decompress()");
+	unsigned w = width_, h = height_;
+	orientation_.output_size(w, h);
+	if (r.x > w || r.w > w - r.x || r.y > h || r.h > h - r.y)
+		throw std::out_of_range("region outside of the image");
+	unsigned step = 1u << r.shift;
+	epng::png ret((r.w + step - 1) >> r.shift, (r.h + step - 1) >> r.shift);
+	if (r.w != 0 && r.h != 0)
+		root_->regionFiller(ret, 0, 0, width_, height_, r, orientation_, width_, height_);
+	return ret;
+}
+
+void quadtree::node::regionFiller(epng::png& output, unsigned x, unsigned y, unsigned w,
+				  unsigned h, const region& r, const orientation& o,
+				  unsigned width, unsigned height)const{
+	//where this rectangle is shown; the region is given in output coordinates
+	unsigned ox = x, oy = y, ow = w, oh = h;
+	o.output_rect(ox, oy, ow, oh, width, height);
+
+	//skip rectangles that miss the region entirely
+	if (ox >= r.x + r.w || oy >= r.y + r.h || ox + ow <= r.x || oy + oh <= r.y)
+		return;
+
+	unsigned step = 1u << r.shift;
+	if (northwest && (w > step || h > step)){
+		qtz::split s(w, h);
+		for (unsigned q = 0; q < 4; q++){
+			if (!s.has(q)) continue;
+			unsigned cx = x, cy = y, cw, ch;
+			s.child(q, cx, cy, cw, ch);
+			child(q)->regionFiller(output, cx, cy, cw, ch, r, o, width, height);
+		}
+		return;
+	}
+
+	//output pixels whose sample points fall inside this rectangle
+	unsigned i0 = (std::max(ox, r.x) - r.x + step - 1) >> r.shift;
+	unsigned i1 = (std::min(ox + ow, r.x + r.w) - r.x + step - 1) >> r.shift;
+	unsigned j0 = (std::max(oy, r.y) - r.y + step - 1) >> r.shift;
+	unsigned j1 = (std::min(oy + oh, r.y + r.h) - r.y + step - 1) >> r.shift;
+	for (unsigned j = j0; j < j1; j++)
+		fill_span(output.row(j) + i0, i1 - i0, element);
+}
+
 void quadtree::rotate_clockwise(){
 	if (!root_) throw std::runtime_error("cannot rotate empty img");
-	root_.get()->rotate_node_clockwise();
+	orientation_.rotate_clockwise();
 }
 
-void quadtree::node::rotate_node_clockwise(){
-	if (!northwest) {
-	//	cout<<"reached the end"<<endl;
-		return;//cannot use this as nullptr, it seems...
+void quadtree::flip_horizontal(){
+	if (!root_) throw std::runtime_error("cannot flip empty img");
+	orientation_.flip_horizontal();
+}
+
+void quadtree::flip_vertical(){
+	if (!root_) throw std::runtime_error("cannot flip empty img");
+	orientation_.flip_vertical();
+}
+
+void quadtree::materialize(){
+	if (!root_ || orientation_.identity()) return;
+	//mirroring swaps the halves of every node, which keeps the west and
+	//north halves the larger ones only when the mirrored side is a power of
+	//two; otherwise the tree is rebuilt from the image it shows, merging
+	//areas of exactly one pixel again (prune ignores alpha, so it cannot)
+	if (((orientation_.tag() & orientation::mirror_x) && !power_of_two(width_))
+	    || ((orientation_.tag() & orientation::mirror_y) && !power_of_two(height_))){
+		quadtree shown(decompress());
+		shown.root_->merge_uniform();
+		swap(shown);
+		return;
 	}
-	else {
-	//	cout<<"reached parent nod"<<endl;
+	node::reorient(root_, orientation_);
+	orientation_.output_size(width_, height_);
+	orientation_ = orientation();
+}
 
-		std::unique_ptr<node> tmp = std::move(northwest);		
-		northwest = std::move(southwest);
-		southwest = std::move(southeast);
-		southeast = std::move(northeast);
-		northeast = std::move(tmp);
+bool quadtree::node::merge_uniform(){
+	if (!northwest) return true;
+	bool uniform = true;
+	for (unsigned q = 0; q < 4; q++)
+		if (child(q) && !child(q)->merge_uniform()) uniform = false;
+	if (!uniform) return false;
+	for (unsigned q = 1; q < 4; q++)
+		if (child(q) && child(q)->element != northwest->element) return false;
+	element = northwest->element;
+	northwest = northeast = southwest = southeast = nullptr;
+	return true;
+}
+
+auto quadtree::node::unshare(std::shared_ptr<node>& slot) ->node*{
+	//a node someone else also holds is swapped for a private copy before it
+	//changes; the copy still shares the children
+	if (slot.use_count() > 1) slot = std::make_shared<node>(*slot);
+	//sole holder: see everything a holder on another prune task did before
+	//it let go (use_count() is only a relaxed load)
+	else std::atomic_thread_fence(std::memory_order_acquire);
+	return slot.get();
+}
+
+void quadtree::node::reorient(std::shared_ptr<node>& slot, const orientation& o){
+	if (!slot->northwest) return;
+	node* n = unshare(slot);
+	//a node one pixel wide (or high) has no eastern (southern) half to swap
+	uint8_t tag = o.tag();
+	if (!n->northeast) tag &= ~orientation::mirror_x;
+	if (!n->southwest) tag &= ~orientation::mirror_y;
+	orientation local(tag);
+	std::shared_ptr<node> children[4] = {std::move(n->northwest), std::move(n->northeast),
+					     std::move(n->southwest), std::move(n->southeast)};
+	for (unsigned q = 0; q < 4; q++){
+		if (children[q]) reorient(children[q], o);
+		n->child(local.output_quadrant(q)) = std::move(children[q]);
+	}
+}
+
+void quadtree::compact(){
+	if (!root_) return;
+	intern_table table;
+	node::intern(root_, table, width_, height_);
+}
 
-	northwest.get()->rotate_node_clockwise();
-	northeast.get()->rotate_node_clockwise();
-	southwest.get()->rotate_node_clockwise();
-	southeast.get()->rotate_node_clockwise();
+void quadtree::node::intern(std::shared_ptr<node>& slot, intern_table& table,
+			    unsigned w, unsigned h){
+	auto done = table.done.find(slot);
+	if (done != table.done.end()){
+		slot = done->second;
+		return;
 	}
+	std::shared_ptr<node> original = slot;
+	node* n = slot.get();
+	if (n->northwest){
+		//children first, so equal subtrees already share their children
+		qtz::split s(w, h);
+		std::shared_ptr<node> children[4] = {n->northwest, n->northeast,
+						     n->southwest, n->southeast};
+		bool changed = false;
+		for (unsigned q = 0; q < 4; q++){
+			if (!s.has(q)) continue;
+			unsigned cx = 0, cy = 0, cw, ch;
+			s.child(q, cx, cy, cw, ch);
+			intern(children[q], table, cw, ch);
+			changed = changed || children[q] != n->child(q);
+		}
+		if (changed){
+			n = unshare(slot);
+			for (unsigned q = 0; q < 4; q++) n->child(q) = std::move(children[q]);
+		}
+	}
+	node_key key{uint32_t(n->element.red) << 24 | uint32_t(n->element.green) << 16
+		     | uint32_t(n->element.blue) << 8 | n->element.alpha,
+		     w, h,
+		     {n->northwest.get(), n->northeast.get(), n->southwest.get(), n->southeast.get()}};
+	auto interned = table.nodes.emplace(key, slot);
+	if (!interned.second) slot = interned.first->second;
+	table.done.emplace(std::move(original), slot);
+}
+
+bool quadtree::node_key::operator==(const node_key& other)const{
+	return color == other.color && width == other.width && height == other.height
+		&& std::equal(children, children + 4, other.children);
+}
+
+size_t quadtree::node_key_hash::operator()(const node_key& key)const{
+	size_t h = std::hash<uint64_t>()(uint64_t(key.color) << 32 | key.width);
+	h = h * 31 + key.height;
+	for (auto child : key.children)
+		h = h * 31 + std::hash<const node*>()(child);
+	return h;
 }
 
 void quadtree::prune(unsigned tolerance){
-	int do_prune = -1;
-	//cout<<root_.get()->element.red<<", "<<root_.get()->element.blue<<endl;
-	root_.get()->node_prune(tolerance, do_prune);	
+	if (!root_) return;
+	node::node_prune(root_, tolerance, parallel_prune_levels(width_, height_));
 }
 
 uint64_t quadtree::pruned_size(uint32_t tolerance) const{
-	unsigned count = 0;
-	root_.get()->prunnable(tolerance, count);
-	return count;
+	if (!root_) return 0;
+	return root_->prunnable(tolerance, parallel_prune_levels(width_, height_));
 }
 
-void quadtree::node::prunnable(unsigned tolerance, unsigned& count){
-	if (all_child_check(this, tolerance, true)) count += 1;
-	else if (!northwest) count+= 1;
-	else{
-		northwest->prunnable(tolerance, count); 
-                northeast->prunnable(tolerance, count); 
-                southwest->prunnable(tolerance, count); 
-                southeast->prunnable(tolerance, count); 
-	}
+uint64_t quadtree::node::prunnable(unsigned tolerance, unsigned parallel)const{
+	if (!northwest || all_child_check(this, tolerance, true)) return 1;
+	//each quadrant counts into its own slot, so the total matches the serial one
+	uint64_t counts[4] = {0, 0, 0, 0};
+	each_quadrant(parallel > 0, [&](unsigned q){
+		if (child(q)) counts[q] = child(q)->prunnable(tolerance, parallel ? parallel - 1 : 0);
+	});
+	return counts[0] + counts[1] + counts[2] + counts[3];
 }
 
-void quadtree::node::node_prune(unsigned tolerance, int& pruned_size){
-	//cout<<element.red;
-	
-	if (!northwest) {
-		if (pruned_size != -1) pruned_size += 1;
+void quadtree::node::node_prune(std::shared_ptr<node>& slot, unsigned tolerance,
+				unsigned parallel){
+	node* n = slot.get();
+	if (!n->northwest) return;
+
+	if (n->all_child_check(n, tolerance, true)) {
+		n = unshare(slot);
+		n->northwest = nullptr;
+		n->northeast = nullptr;
+		n->southwest = nullptr;
+		n->southeast = nullptr;
 		return;
 	}
 
-//	cout<<int(element.blue)<<endl;
-
-	if (all_child_check(this, tolerance, true)) {
-			if (pruned_size == -1) {
-			//cout<<"entered prune process"<<endl;
-				northwest = nullptr;
-				northeast = nullptr;
-				southwest = nullptr;
-				southeast = nullptr;
-			}
-			else pruned_size -= 3; //it would be at least 4 before minus 3
-		}
-	else  {
-	if (pruned_size != -1) pruned_size += 1;
-	northwest->node_prune(tolerance, pruned_size);
-	northeast->node_prune(tolerance, pruned_size);
-	southwest->node_prune(tolerance, pruned_size);
-	southeast->node_prune(tolerance, pruned_size);
+	//the quadrants are separate subtrees (or shared ones, which are copied
+	//before they change), so they can be pruned concurrently
+	unsigned below = parallel ? parallel - 1 : 0;
+	if (slot.use_count() == 1) {
+		//only this slot holds the node, so its children can be pruned in place
+		std::atomic_thread_fence(std::memory_order_acquire);
+		each_quadrant(parallel > 0, [&](unsigned q){
+			if (n->child(q)) node_prune(n->child(q), tolerance, below);
+		});
+		return;
 	}
 
+	//shared: prune copies of the child pointers, and only copy this node
+	//if one of them actually changed
+	std::shared_ptr<node> children[4] = {n->northwest, n->northeast,
+					     n->southwest, n->southeast};
+	each_quadrant(parallel > 0, [&](unsigned q){
+		if (children[q]) node_prune(children[q], tolerance, below);
+	});
+	bool changed = false;
+	for (unsigned q = 0; q < 4; q++)
+		changed = changed || children[q] != n->child(q);
+	if (!changed) return;
+	n = unshare(slot);
+	for (unsigned q = 0; q < 4; q++) n->child(q) = std::move(children[q]);
 }
 
 bool quadtree::node::all_child_check(const node* c, unsigned tolerance, bool prunable)const {
 
 	if (this == c && !c->northwest) return false; 
 	if (!c->northwest) return check_tolerance(c, tolerance);
-	else return prunable 
-		&& all_child_check(c->northwest.get(), tolerance, prunable) 
-		&& all_child_check(c->northeast.get(), tolerance, prunable)
-		&& all_child_check(c->southeast.get(), tolerance, prunable)
-		&& all_child_check(c->southwest.get(), tolerance, prunable);
+	if (!prunable) return false;
+	for (unsigned q = 0; q < 4; q++)
+		if (c->child(q) && !all_child_check(c->child(q).get(), tolerance, prunable))
+			return false;
+	return true;
 }
 
 bool quadtree::node::check_tolerance(const node* b, unsigned tolerance)const{
@@ -255,40 +773,17 @@ bool quadtree::node::check_tolerance(const node* b, unsigned tolerance)const{
 }
 
 uint32_t quadtree::ideal_prune(unsigned num_leaves) const{
-		uint32_t min = 0;
-		uint32_t max = 3*255*255;
-		unsigned currentLeaves = this->pruned_size(min+max/2);
-	while(1)
-	{	if (currentLeaves > num_leaves){
-			max = min+(max-min)/2;
-			currentLeaves = pruned_size(min+(max-min)/2);
-		}
-		if (currentLeaves < num_leaves){
-			if (min+1 == max) break;
-			min = min+(max-min)/2;
-			currentLeaves = pruned_size(min+(max-min)/2);
-		}
+	//pruned_size never grows with the tolerance, so binary search for the
+	//smallest tolerance that leaves at most num_leaves
+	uint32_t min = 0;
+	uint32_t max = 3*255*255;
+	while (min < max){
+		uint32_t mid = min + (max - min) / 2;
+		if (pruned_size(mid) <= num_leaves) max = mid;
+		else min = mid + 1;
 	}
-		cout<<currentLeaves;
-		return min;
-}
-/*
-		unsigned currentLeaves = pruned_size((min+max)/2);
-		if (currentLeaves < num_leaves) return max;
-		while (min!=max){
-			if (currentLeaves > num_leaves) {
-				max = min+(max-min)/2;
-				cout<<"has been here"<<endl;
-			}
-			if (currentLeaves < num_leaves){
-				min = min+(max-min)/2;
-			
-			}
-			if (min+1 == max) break;
-		}
-	return 0;
+	return min;
 }
-*/
 /*	if (!northwest) {
 		if (pruned_size != -1) pruned_size += 1;
 		cout<<"reached unmodified pix"<<endl;
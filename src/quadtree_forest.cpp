@@ -0,0 +1,244 @@
+/**
+ * @file quadtree_forest.cpp
+ * Implementation of the quadtree_forest class.
+ *
+ * @date Fall 2026
+ */
+
+#include <algorithm>
+#include <cstdio>
+#include <stdexcept>
+
+#include "binary_file_reader.h"
+#include "binary_file_writer.h"
+#include "qtz.h"
+#include "quadtree_forest.h"
+#include "row_reader.h"
+
+namespace cs225
+{
+
+quadtree_forest::quadtree_forest(const std::string& png_file,
+                                 const std::string& backing_file,
+                                 unsigned tile, size_t max_resident)
+    : backing_{backing_file},
+      backing_size_{0},
+      dead_{0},
+      width_{0},
+      height_{0},
+      tile_{tile},
+      max_resident_{std::max<size_t>(max_resident, 1)}
+{
+    if (tile == 0)
+        throw std::invalid_argument{"tiles must be at least one pixel"};
+
+    epng::row_reader rows{png_file};
+    width_ = rows.width();
+    height_ = rows.height();
+    // start with an empty backing file
+    std::ofstream{backing_, std::ios::binary | std::ios::trunc};
+    if (width_ == 0 || height_ == 0)
+        return;
+
+    // read one band of tile rows at a time, and cut it into tiles
+    epng::png band(width_, std::min(tile_, height_));
+    for (unsigned band_y = 0; band_y < height_; band_y += tile_)
+    {
+        unsigned band_h = std::min(tile_, height_ - band_y);
+        for (unsigned j = 0; j < band_h; ++j)
+            rows.read_row(band.row(j));
+
+        for (unsigned tile_x = 0; tile_x < width_; tile_x += tile_)
+        {
+            unsigned tile_w = std::min(tile_, width_ - tile_x);
+            epng::png pixels(tile_w, band_h);
+            for (unsigned j = 0; j < band_h; ++j)
+                std::copy(band.row(j) + tile_x, band.row(j) + tile_x + tile_w,
+                          pixels.row(j));
+
+            std::unique_ptr<quadtree> tree{new quadtree{pixels}};
+            tiles_.push_back(
+                {tile_x, band_y, tile_w, band_h, 0, 0, nullptr, false, {}});
+            store(tiles_.back(), *tree);
+            make_resident(tiles_.size() - 1, std::move(tree));
+        }
+    }
+}
+
+unsigned quadtree_forest::width() const
+{
+    return width_;
+}
+
+unsigned quadtree_forest::height() const
+{
+    return height_;
+}
+
+size_t quadtree_forest::tile_count() const
+{
+    return tiles_.size();
+}
+
+size_t quadtree_forest::resident() const
+{
+    return lru_.size();
+}
+
+void quadtree_forest::prune(unsigned tolerance)
+{
+    for (size_t i = 0; i < tiles_.size(); ++i)
+    {
+        // a copy shares every node, and prune only copies the ones it
+        // changes, so comparing the two is cheap when nothing changed
+        quadtree& tree = page_in(i);
+        quadtree before{tree};
+        tree.prune(tolerance);
+        if (!(tree == before))
+            tiles_[i].dirty = true;
+    }
+}
+
+uint64_t quadtree_forest::pruned_size(unsigned tolerance)
+{
+    uint64_t leaves = 0;
+    for (size_t i = 0; i < tiles_.size(); ++i)
+        leaves += page_in(i).pruned_size(tolerance);
+    return leaves;
+}
+
+epng::png quadtree_forest::decompress_region(unsigned x, unsigned y,
+                                             unsigned w, unsigned h)
+{
+    if (x > width_ || w > width_ - x || y > height_ || h > height_ - y)
+        throw std::out_of_range{"region outside of the image"};
+    epng::png out(w, h);
+    if (w == 0 || h == 0)
+        return out;
+
+    size_t columns = (width_ + tile_ - 1) / tile_;
+    for (unsigned ty = y / tile_; ty * tile_ < y + h; ++ty)
+    {
+        for (unsigned tx = x / tile_; tx * tile_ < x + w; ++tx)
+        {
+            tile_entry& entry = tiles_[ty * columns + tx];
+            // the part of the region inside this tile, in tile coordinates,
+            // and where it goes in out
+            unsigned x0 = std::max(x, entry.x) - entry.x;
+            unsigned y0 = std::max(y, entry.y) - entry.y;
+            unsigned x1 = std::min(x + w, entry.x + entry.w) - entry.x;
+            unsigned y1 = std::min(y + h, entry.y + entry.h) - entry.y;
+            unsigned out_x = entry.x + x0 - x;
+            unsigned out_y = entry.y + y0 - y;
+
+            if (entry.tree)
+            {
+                lru_.splice(lru_.begin(), lru_, entry.lru);
+                auto part = entry.tree->decompress_region(x0, y0, x1 - x0,
+                                                          y1 - y0);
+                for (unsigned j = 0; j < part.height(); ++j)
+                    std::copy(part.row(j), part.row(j) + part.width(),
+                              out.row(out_y + j) + out_x);
+                continue;
+            }
+
+            binary_file_reader bfile{backing_, entry.offset, entry.length};
+            auto hdr = qtz::read_header(bfile);
+            qtz::decode(bfile, hdr, [&](unsigned sx, unsigned sy,
+                                        unsigned length,
+                                        const epng::rgba_pixel& color)
+            {
+                unsigned from = std::max(sx, x0);
+                unsigned to = std::min(sx + length, x1);
+                if (sy < y0 || sy >= y1 || from >= to)
+                    return;
+                epng::rgba_pixel* row = out.row(out_y + sy - y0) + out_x;
+                std::fill(row + from - x0, row + to - x0, color);
+            });
+        }
+    }
+    return out;
+}
+
+void quadtree_forest::store(tile_entry& entry, const quadtree& tree)
+{
+    {
+        binary_file_writer bfile{backing_, true};
+        tree.write(bfile);
+    }
+    std::ifstream file{backing_, std::ios::binary | std::ios::ate};
+    std::streamoff end = file.tellg();
+    dead_ += entry.length;
+    entry.offset = backing_size_;
+    entry.length = end - backing_size_;
+    entry.dirty = false;
+    backing_size_ = end;
+    if (dead_ > backing_size_ - dead_)
+        compact();
+}
+
+void quadtree_forest::compact()
+{
+    // copy every tile's newest stream to a new file, in tile order, and
+    // only then replace the old one
+    std::string temp = backing_ + ".compact";
+    std::vector<std::streamoff> offsets;
+    std::streamoff size = 0;
+    {
+        std::ifstream in{backing_, std::ios::binary};
+        std::ofstream out{temp, std::ios::binary | std::ios::trunc};
+        std::vector<char> stream;
+        for (const auto& entry : tiles_)
+        {
+            stream.resize(entry.length);
+            in.seekg(entry.offset);
+            in.read(stream.data(), entry.length);
+            out.write(stream.data(), entry.length);
+            offsets.push_back(size);
+            size += entry.length;
+        }
+        out.flush();
+        if (!in || !out)
+            throw std::runtime_error{"could not compact " + backing_};
+    }
+    if (std::rename(temp.c_str(), backing_.c_str()) != 0)
+        throw std::runtime_error{"could not replace " + backing_};
+
+    for (size_t i = 0; i < tiles_.size(); ++i)
+        tiles_[i].offset = offsets[i];
+    backing_size_ = size;
+    dead_ = 0;
+}
+
+quadtree& quadtree_forest::page_in(size_t index)
+{
+    tile_entry& entry = tiles_[index];
+    if (entry.tree)
+    {
+        lru_.splice(lru_.begin(), lru_, entry.lru);
+        return *entry.tree;
+    }
+
+    std::unique_ptr<quadtree> tree{new quadtree};
+    binary_file_reader bfile{backing_, entry.offset, entry.length};
+    tree->read(bfile);
+    make_resident(index, std::move(tree));
+    return *entry.tree;
+}
+
+void quadtree_forest::make_resident(size_t index,
+                                    std::unique_ptr<quadtree> tree)
+{
+    tiles_[index].tree = std::move(tree);
+    lru_.push_front(index);
+    tiles_[index].lru = lru_.begin();
+    while (lru_.size() > max_resident_)
+    {
+        tile_entry& victim = tiles_[lru_.back()];
+        if (victim.dirty)
+            store(victim, *victim.tree);
+        victim.tree.reset();
+        lru_.pop_back();
+    }
+}
+}
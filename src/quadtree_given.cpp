@@ -12,13 +12,24 @@ void quadtree::print(std::ostream& out /* = cout */) const
 {
     if (!root_)
         out << "Empty tree.\n";
+    else if (!orientation_.identity())
+    {
+        // print the tree as it is shown, not as it is stored
+        quadtree shown{*this};
+        shown.materialize();
+        shown.print(out);
+    }
     else
         print(out, root_.get(), 1);
 }
 
 void quadtree::print(std::ostream& out, const node* current, int level) const
 {
-    if (!current->northeast)
+    // children of nodes one pixel wide or high may be missing
+    if (!current)
+        return;
+
+    if (!current->northwest)
     {
         out << current->element << " at depth " << level << "\n";
         return;
@@ -32,18 +43,27 @@ void quadtree::print(std::ostream& out, const node* current, int level) const
 }
 bool quadtree::operator==(const quadtree& other) const
 {
+    if (orientation_.tag() != other.orientation_.tag())
+    {
+        quadtree first{*this};
+        quadtree second{other};
+        first.materialize();
+        second.materialize();
+        return first == second;
+    }
     return equal(root_.get(), other.root_.get());
 }
 
 bool quadtree::equal(const node* first, const node* second) const
 {
-    if (!first && !second)
+    // shared subtrees (see compact) are equal without looking inside
+    if (first == second)
         return true;
 
     if (!first || !second)
         return false;
 
-    if (!first->northeast && !second->northeast)
+    if (!first->northwest && !second->northwest)
         return first->element == second->element;
 
     // they aren't both leaves, so recurse
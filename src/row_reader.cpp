@@ -0,0 +1,150 @@
+/**
+ * @file row_reader.cpp
+ * Implementation of the row_reader class.
+ *
+ * @date Fall 2026
+ */
+
+#include <cstdio>
+#include <stdexcept>
+#include <vector>
+#include <png.h>
+
+#include "row_reader.h"
+
+namespace epng
+{
+
+/**
+ * The libpng state of an open file; freed when the reader goes away,
+ * whether or not it was fully constructed.
+ */
+struct row_reader::impl
+{
+    FILE* fp = nullptr;
+    png_structp png_ptr = nullptr;
+    png_infop info_ptr = nullptr;
+    std::vector<png_byte> row;
+    int channels = 0;
+
+    ~impl()
+    {
+        if (png_ptr)
+            png_destroy_read_struct(&png_ptr, info_ptr ? &info_ptr : nullptr,
+                                    nullptr);
+        if (fp)
+            fclose(fp);
+    }
+};
+
+row_reader::row_reader(const std::string& file_name)
+    : impl_{new impl}, width_{0}, height_{0}, rows_read_{0}
+{
+    impl_->fp = fopen(file_name.c_str(), "rb");
+    if (!impl_->fp)
+        throw std::runtime_error{"failed to open " + file_name};
+
+    png_byte header[8];
+    if (fread(header, 1, 8, impl_->fp) != 8 || png_sig_cmp(header, 0, 8))
+        throw std::runtime_error{file_name + " is not a valid png file"};
+
+    impl_->png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, nullptr,
+                                            nullptr, nullptr);
+    if (!impl_->png_ptr)
+        throw std::runtime_error{"Failed to create libpng read struct"};
+    png_structp png_ptr = impl_->png_ptr;
+
+    impl_->info_ptr = png_create_info_struct(png_ptr);
+    if (!impl_->info_ptr)
+        throw std::runtime_error{"Failed to create libpng info struct"};
+    png_infop info_ptr = impl_->info_ptr;
+
+    // set error handling to not abort the entire program
+    if (setjmp(png_jmpbuf(png_ptr)))
+        throw std::runtime_error{"Error reading png metadata"};
+
+    png_init_io(png_ptr, impl_->fp);
+    png_set_sig_bytes(png_ptr, 8);
+    png_read_info(png_ptr, info_ptr);
+
+    if (png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE)
+        throw std::runtime_error{file_name
+                                 + " is interlaced and cannot be streamed"};
+
+    // the same conversions to 8 bit RGB(A) as png::load
+    png_byte bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+    if (bit_depth == 16)
+        png_set_strip_16(png_ptr);
+
+    png_byte color_type = png_get_color_type(png_ptr, info_ptr);
+    if (color_type != PNG_COLOR_TYPE_RGBA && color_type != PNG_COLOR_TYPE_RGB)
+    {
+        if (color_type == PNG_COLOR_TYPE_GRAY || color_type
+                                                 == PNG_COLOR_TYPE_GRAY_ALPHA)
+        {
+            if (bit_depth < 8)
+                png_set_expand(png_ptr);
+            png_set_gray_to_rgb(png_ptr);
+        }
+        if (color_type == PNG_COLOR_TYPE_PALETTE)
+            png_set_palette_to_rgb(png_ptr);
+    }
+    if (png_get_valid(png_ptr, info_ptr, PNG_INFO_tRNS))
+        png_set_tRNS_to_alpha(png_ptr);
+
+    width_ = png_get_image_width(png_ptr, info_ptr);
+    height_ = png_get_image_height(png_ptr, info_ptr);
+
+    png_read_update_info(png_ptr, info_ptr);
+    impl_->row.resize(png_get_rowbytes(png_ptr, info_ptr));
+    impl_->channels = png_get_channels(png_ptr, info_ptr);
+}
+
+row_reader::~row_reader() = default;
+
+size_t row_reader::width() const
+{
+    return width_;
+}
+
+size_t row_reader::height() const
+{
+    return height_;
+}
+
+size_t row_reader::rows_read() const
+{
+    return rows_read_;
+}
+
+void row_reader::read_row(rgba_pixel* out)
+{
+    if (rows_read_ == height_)
+        throw std::out_of_range{"every row has been read"};
+
+    if (setjmp(png_jmpbuf(impl_->png_ptr)))
+        throw std::runtime_error{"Error reading image with libpng"};
+    png_read_row(impl_->png_ptr, impl_->row.data(), nullptr);
+
+    int numchannels = impl_->channels;
+    const png_byte* pix = impl_->row.data();
+    for (size_t x = 0; x < width_; x++)
+    {
+        rgba_pixel& px = out[x];
+        if (numchannels == 1 || numchannels == 2)
+        {
+            // monochrome
+            px.red = px.green = px.blue = *pix++;
+            px.alpha = numchannels == 2 ? *pix++ : 255;
+        }
+        else
+        {
+            px.red = *pix++;
+            px.green = *pix++;
+            px.blue = *pix++;
+            px.alpha = numchannels == 4 ? *pix++ : 255;
+        }
+    }
+    ++rows_read_;
+}
+}
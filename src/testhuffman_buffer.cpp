@@ -0,0 +1,197 @@
+/**
+ * @file testhuffman_buffer.cpp
+ * Round trips buffers through both forms of huffman_buffer's encode and
+ * decode, checks that they allocate nothing when the caller provides the
+ * room, and that damaged buffers are rejected before anything is
+ * allocated. Prints only the failures, then whether all passed.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <new>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "huffman_buffer.h"
+
+using namespace std;
+
+namespace
+{
+// every operator new in the program goes through these counters
+uint64_t allocations = 0;
+uint64_t largest_allocation = 0;
+}
+
+void* operator new(size_t size)
+{
+    ++allocations;
+    largest_allocation = max<uint64_t>(largest_allocation, size);
+    if (void* p = malloc(size ? size : 1))
+        return p;
+    throw bad_alloc{};
+}
+
+void operator delete(void* p) noexcept
+{
+    free(p);
+}
+
+void operator delete(void* p, size_t) noexcept
+{
+    free(p);
+}
+
+namespace
+{
+bool passed = true;
+
+void fail(const string& name, const string& what)
+{
+    cout << "FAIL: " << name << ": " << what << endl;
+    passed = false;
+}
+
+/**
+ * Encodes and decodes data with both overloads of each, checking that
+ * the pointer overloads and reused outputs allocate nothing.
+ */
+void round_trip(const string& name, const string& data)
+{
+    vector<uint8_t> coded;
+    huffman_buffer::encode(data.data(), data.size(), coded);
+    string decoded;
+    huffman_buffer::decode(coded.data(), coded.size(), decoded);
+    if (decoded != data)
+        fail(name, "vector and string round trip changed the data");
+
+    vector<uint8_t> out(huffman_buffer::max_encoded_size(data.size()));
+    string back(data.size(), '\0');
+    uint64_t before = allocations;
+    size_t size = huffman_buffer::encode(data.data(), data.size(), out.data(),
+                                         out.size());
+    size_t length = huffman_buffer::decode(out.data(), size, &back[0],
+                                           back.size());
+    huffman_buffer::encode(data.data(), data.size(), coded);
+    huffman_buffer::decode(coded.data(), coded.size(), decoded);
+    if (allocations != before)
+        fail(name, to_string(allocations - before) + " allocations");
+    if (length != data.size() || back != data)
+        fail(name, "pointer round trip changed the data");
+    if (size != coded.size() || !equal(coded.begin(), coded.end(), out.data()))
+        fail(name, "the two encodes differ");
+}
+
+/**
+ * Checks that decoding a buffer into a string throws the exception
+ * expected, without allocating more than the buffer's codes could decode
+ * to.
+ */
+template <class Exception>
+void rejects(const string& name, const vector<uint8_t>& coded,
+             uint64_t max_size = huffman_buffer::default_max_decoded_size)
+{
+    string out;
+    largest_allocation = 0;
+    try
+    {
+        huffman_buffer::decode(coded.data(), coded.size(), out, max_size);
+        fail(name, "was decoded");
+    }
+    catch (const Exception&)
+    {
+    }
+    catch (const exception& e)
+    {
+        fail(name, string("threw ") + e.what());
+    }
+    if (largest_allocation > max<uint64_t>(4096, 8 * coded.size()))
+        fail(name, "allocated " + to_string(largest_allocation) + " bytes");
+}
+
+/**
+ * Sets the length in a coded buffer's header.
+ */
+void set_length(vector<uint8_t>& coded, uint64_t length)
+{
+    for (int i = 0; i < 8; ++i)
+        coded[sizeof(huffman_buffer::magic) + 8 - i] =
+            static_cast<uint8_t>(length >> (8 * i));
+}
+}
+
+int main()
+{
+    mt19937 random(225);
+    string text;
+    for (int i = 0; i < 200; ++i)
+        text += "the quick brown fox jumps over the lazy dog " + to_string(i)
+                + "\n";
+    string noise(100000, '\0');
+    for (auto& c : noise)
+        c = static_cast<char>(random());
+    string skewed(100000, '\0');
+    geometric_distribution<int> geometric(0.2);
+    for (auto& c : skewed)
+        c = static_cast<char>(geometric(random));
+
+    round_trip("empty", "");
+    round_trip("one", "z");
+    round_trip("single", string(100000, 'z'));
+    round_trip("two", "ab");
+    round_trip("text", text);
+    round_trip("random", noise);
+    round_trip("skewed", skewed);
+
+    vector<uint8_t> stored;
+    huffman_buffer::encode("xyz", 3, stored);
+    vector<uint8_t> coded;
+    huffman_buffer::encode(text.data(), text.size(), coded);
+    vector<uint8_t> single;
+    huffman_buffer::encode(string(1000, 'z').data(), 1000, single);
+
+    rejects<runtime_error>("short header", {'H', 'U', 'F', 'M', 0});
+    auto bad_magic = stored;
+    bad_magic[0] = 'X';
+    rejects<runtime_error>("bad magic", bad_magic);
+    auto bad_mode = stored;
+    bad_mode[sizeof(huffman_buffer::magic)] = 7;
+    rejects<runtime_error>("bad mode", bad_mode);
+    for (uint64_t length : {uint64_t(2), uint64_t(4), uint64_t(3) << 30,
+                            ~uint64_t(0)})
+    {
+        auto damaged = stored;
+        set_length(damaged, length);
+        rejects<runtime_error>("stored length " + to_string(length), damaged);
+        damaged = coded;
+        set_length(damaged, length);
+        if (length > text.size())
+            rejects<runtime_error>("coded length " + to_string(length),
+                                   damaged);
+    }
+    auto truncated = coded;
+    truncated.resize(huffman_buffer::header_size + 3);
+    rejects<runtime_error>("truncated table", truncated);
+    truncated = coded;
+    truncated.resize(coded.size() / 2);
+    rejects<runtime_error>("truncated codes", truncated);
+    auto bad_table = coded;
+    bad_table[huffman_buffer::header_size + 2] = 0;
+    rejects<runtime_error>("bad table", bad_table);
+    auto huge = single;
+    set_length(huge, uint64_t(3) << 30);
+    rejects<length_error>("single over the limit", huge);
+    rejects<length_error>("single over max_size", single, 999);
+    string out;
+    huffman_buffer::decode(single.data(), single.size(), out, 1000);
+    if (out != string(1000, 'z'))
+        fail("single at max_size", "changed the data");
+
+    if (passed)
+        cout << "huffman buffer tests ok" << endl;
+    return passed ? 0 : 1;
+}
@@ -0,0 +1,83 @@
+#!/usr/bin/env bash
+# Encodes and decodes a few awkward inputs in every encoder mode and checks
+# that each comes back unchanged. Run from the directory holding encoder
+# and decoder, after make -f Makefile-huffman.
+
+status=0
+dir=$(mktemp -d)
+trap 'rm -rf "$dir"' EXIT
+
+printf '' > "$dir/empty"
+printf 'z' > "$dir/one"
+printf 'zzzzzzzz' > "$dir/single"
+printf 'ab' > "$dir/two"
+head -c 100000 /dev/zero > "$dir/zeros"
+cat src/*.cpp > "$dir/text" 2>/dev/null || printf 'some text\n' > "$dir/text"
+# letter i occurs 2^i times, so its optimal codes run to 17 bits
+awk 'BEGIN { for (i = 0; i < 18; ++i) for (j = 0; j < 2 ^ i; ++j)
+    printf "%c", 65 + i }' > "$dir/skewed"
+
+check()
+{
+    if ! cmp -s "$1" "$2"
+    then
+        echo "FAIL: $3 $(basename "$1")"
+        status=1
+    fi
+}
+
+for input in "$dir"/one "$dir"/single "$dir"/two "$dir"/zeros "$dir"/text \
+    "$dir"/skewed
+do
+    ./encoder "$input" "$input.huff" "$input.tree" > /dev/null &&
+        ./decoder "$input.huff" "$input.tree" "$input.out"
+    check "$input" "$input.out" "two file"
+
+    ./encoder --canonical "$input" "$input.chuff" "$input.ctree" > /dev/null &&
+        ./decoder "$input.chuff" "$input.ctree" "$input.cout"
+    check "$input" "$input.cout" "canonical"
+
+    ./encoder --blocks --block-size 4096 "$input" "$input.hblk" \
+        "$input.btree" > /dev/null &&
+        ./decoder "$input.hblk" "$input.btree" "$input.bout"
+    check "$input" "$input.bout" "blocks"
+
+    ./encoder --interleaved --block-size 4096 --threads 3 "$input" \
+        "$input.hint" "$input.itree" > /dev/null &&
+        ./decoder --threads 2 "$input.hint" "$input.itree" "$input.iout"
+    check "$input" "$input.iout" "interleaved"
+
+    ./encoder --max-length 8 "$input" "$input.h8" "$input.tree8" \
+        > /dev/null &&
+        ./decoder "$input.h8" "$input.tree8" "$input.out8"
+    check "$input" "$input.out8" "max length 8"
+
+    ./encoder --blocks --max-length 0 --canonical --block-size 4096 \
+        "$input" "$input.h0" "$input.tree0" > /dev/null &&
+        ./decoder --threads 1 "$input.h0" "$input.tree0" "$input.out0"
+    check "$input" "$input.out0" "no length limit"
+done
+
+for input in "$dir"/empty "$dir"/one "$dir"/single "$dir"/two "$dir"/zeros \
+    "$dir"/text "$dir"/skewed
+do
+    ./encoder --stream "$input" "$input.hufs" > /dev/null &&
+        ./decoder "$input.hufs" "$input.sout"
+    check "$input" "$input.sout" "stream"
+
+    ./encoder --stream --block-size 4096 - - < "$input" |
+        ./decoder - - > "$input.pout"
+    check "$input" "$input.pout" "stream through pipes"
+
+    ./encoder --stream --interleaved --max-length 9 --block-size 4096 \
+        "$input" - | ./decoder - "$input.ipout"
+    check "$input" "$input.ipout" "interleaved stream"
+done
+
+# a file encoded through a pipe reads the same as one encoded from a file
+./encoder --stream - "$dir/text.pipe" < "$dir/text" > /dev/null &&
+    ./decoder "$dir/text.pipe" - > "$dir/text.pipe.out"
+check "$dir/text" "$dir/text.pipe.out" "stream from stdin"
+
+[ $status -eq 0 ] && echo "huffman round trips ok"
+exit $status